@@ -0,0 +1,252 @@
+/* Deterministic workload generator for benchmarking ringmaster
+ * It writes a script of valid sentences and questions to stdout, the same options and seed always give the same script
+ * The first sentences give every person some of every item so that sell and buy from actions usually succeed
+ * With --templates N every line is one of N different lines, like a simulation that replays the same sentences
+ * usage: workload [--sentences N] [--people N] [--items N] [--locations N] [--subjects N] [--depth N] [--templates N] [--seed N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define NAME_LENGTH 32
+
+unsigned long long state; // state of the random number generator
+
+unsigned long long nextRandom();
+int randomBelow(int bound);
+void makeName(char *buffer, char *prefix, int index);
+void pickDistinct(int *picked, int count, int bound);
+void writeSubjects(int *subjects, int count);
+void writeItems(int item_count, int amount_limit);
+void writeAction(int people, int items, int locations, int max_subjects);
+void writeCondition(int people, int items, int locations, int max_subjects);
+void writeSentence(int people, int items, int locations, int max_subjects, int depth);
+void writeQuestion(int people, int items, int locations, int max_subjects);
+
+int main(int argc, char *argv[]){
+    int sentences = 100000; // number of lines after the initial inventory
+    int people = 1000;
+    int items = 50;
+    int locations = 20;
+    int max_subjects = 4; // at most this many subjects in each action, condition and question
+    int depth = 2; // at most this many "if" in a sentence
+    int templates = 0; // 0 if every line is generated independently
+    unsigned long long seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        long long value = atoll(argv[i + 1]);
+        if (strcmp(argv[i], "--sentences") == 0) sentences = value;
+        else if (strcmp(argv[i], "--people") == 0) people = value;
+        else if (strcmp(argv[i], "--items") == 0) items = value;
+        else if (strcmp(argv[i], "--locations") == 0) locations = value;
+        else if (strcmp(argv[i], "--subjects") == 0) max_subjects = value;
+        else if (strcmp(argv[i], "--depth") == 0) depth = value;
+        else if (strcmp(argv[i], "--templates") == 0) templates = value;
+        else if (strcmp(argv[i], "--seed") == 0) seed = value;
+        else{
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (argc % 2 == 0 || people < 2 || items < 1 || locations < 1 || max_subjects < 1 || depth < 0 || templates < 0){
+        fprintf(stderr, "usage: %s [--sentences N] [--people N] [--items N] [--locations N] [--subjects N] [--depth N] [--templates N] [--seed N]\n", argv[0]);
+        return 1;
+    }
+    if (max_subjects > people - 1){ // a trader can not be one of the subjects
+        max_subjects = people - 1;
+    }
+    state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    // Initial inventory
+    char name[NAME_LENGTH];
+    for (int i = 0; i < people; ++i) {
+        makeName(name, "person_", i);
+        printf("%s buy ", name);
+        for (int j = 0; j < items; ++j) {
+            makeName(name, "item_", j);
+            printf(j == 0 ? "1000 %s" : " and 1000 %s", name);
+        }
+        printf("\n");
+    }
+
+    for (int i = 0; i < sentences; ++i) {
+        unsigned long long saved_state = 0;
+        if (templates > 0){ // a template is generated from its own state so it is the same line every time
+            unsigned long long template = randomBelow(templates);
+            saved_state = state;
+            state = (seed * 0x9E3779B97F4A7C15ULL) ^ ((template + 1) * 0xBF58476D1CE4E5B9ULL);
+        }
+        if (randomBelow(10) < 7){ // 70% of the lines are sentences
+            writeSentence(people, items, locations, max_subjects, depth);
+        }
+        else{
+            writeQuestion(people, items, locations, max_subjects);
+        }
+        if (templates > 0){
+            state = saved_state;
+        }
+    }
+    printf("exit\n");
+    return 0;
+}
+
+// xorshift64*
+unsigned long long nextRandom(){
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+int randomBelow(int bound){
+    return (int) (nextRandom() % (unsigned long long) bound);
+}
+
+// Names only have letters and underscores, the prefix keeps them from being keywords
+void makeName(char *buffer, char *prefix, int index){
+    int length = strlen(prefix);
+    memcpy(buffer, prefix, length);
+    do {
+        buffer[length++] = 'a' + index % 26;
+        index /= 26;
+    } while (index > 0);
+    buffer[length] = '\0';
+}
+
+// Fills picked with count distinct numbers below bound
+void pickDistinct(int *picked, int count, int bound){
+    for (int i = 0; i < count; ++i) {
+        bool duplicate;
+        do {
+            picked[i] = randomBelow(bound);
+            duplicate = false;
+            for (int j = 0; j < i; ++j) {
+                if (picked[j] == picked[i]){
+                    duplicate = true;
+                    break;
+                }
+            }
+        } while (duplicate);
+    }
+}
+
+void writeSubjects(int *subjects, int count){
+    char name[NAME_LENGTH];
+    for (int i = 0; i < count; ++i) {
+        makeName(name, "person_", subjects[i]);
+        printf(i == 0 ? "%s" : " and %s", name);
+    }
+}
+
+// Writes "amount item (and amount item)*" with up to 3 distinct items
+void writeItems(int item_count, int amount_limit){
+    int picked[3];
+    int count = 1 + randomBelow(item_count < 3 ? item_count : 3);
+    pickDistinct(picked, count, item_count);
+    char name[NAME_LENGTH];
+    for (int i = 0; i < count; ++i) {
+        makeName(name, "item_", picked[i]);
+        printf(i == 0 ? " %d %s" : " and %d %s", randomBelow(amount_limit), name);
+    }
+}
+
+// Writes one action: go to, buy, sell, buy from or sell to
+void writeAction(int people, int items, int locations, int max_subjects){
+    int subjects[max_subjects + 1];
+    int count = 1 + randomBelow(max_subjects);
+    pickDistinct(subjects, count + 1, people); // the extra person is the trader
+    writeSubjects(subjects, count);
+    char name[NAME_LENGTH];
+    int kind = randomBelow(5);
+    if (kind == 0){
+        makeName(name, "place_", randomBelow(locations));
+        printf(" go to %s", name);
+        return;
+    }
+    printf(kind % 2 == 1 ? " buy" : " sell");
+    writeItems(items, 10);
+    if (kind >= 3){
+        makeName(name, "person_", subjects[count]);
+        printf(kind == 3 ? " from %s" : " to %s", name);
+    }
+}
+
+// Writes one condition: at, has, has more than or has less than
+void writeCondition(int people, int items, int locations, int max_subjects){
+    int subjects[max_subjects];
+    int count = 1 + randomBelow(max_subjects);
+    pickDistinct(subjects, count, people);
+    writeSubjects(subjects, count);
+    char name[NAME_LENGTH];
+    int kind = randomBelow(4);
+    if (kind == 0){
+        makeName(name, "place_", randomBelow(locations));
+        printf(" at %s", name);
+        return;
+    }
+    printf(kind == 1 ? " has" : kind == 2 ? " has more than" : " has less than");
+    writeItems(items, 2000);
+}
+
+// Writes up to depth action sequences that each have up to 3 actions and a condition sequence
+void writeSentence(int people, int items, int locations, int max_subjects, int depth){
+    int sequences = 1 + randomBelow(depth + 1);
+    for (int i = 0; i < sequences; ++i) {
+        if (i > 0){
+            printf(" and ");
+        }
+        int actions = 1 + randomBelow(3);
+        for (int j = 0; j < actions; ++j) {
+            if (j > 0){
+                printf(" and ");
+            }
+            writeAction(people, items, locations, max_subjects);
+        }
+        if (i < depth && (i < sequences - 1 || randomBelow(2) == 0)){
+            printf(" if ");
+            int conditions = 1 + randomBelow(2);
+            for (int j = 0; j < conditions; ++j) {
+                if (j > 0){
+                    printf(" and ");
+                }
+                writeCondition(people, items, locations, max_subjects);
+            }
+        }
+        else{ // only the last action sequence may have no condition sequence
+            break;
+        }
+    }
+    printf("\n");
+}
+
+// Writes one of where, total, total item, multi subject total item and who at questions
+void writeQuestion(int people, int items, int locations, int max_subjects){
+    char name[NAME_LENGTH];
+    int kind = randomBelow(5);
+    if (kind == 0){
+        makeName(name, "place_", randomBelow(locations));
+        printf("who at %s ?\n", name);
+        return;
+    }
+    if (kind == 1){
+        int subjects[max_subjects];
+        int count = 1 + randomBelow(max_subjects);
+        pickDistinct(subjects, count, people);
+        writeSubjects(subjects, count);
+        makeName(name, "item_", randomBelow(items));
+        printf(" total %s ?\n", name);
+        return;
+    }
+    makeName(name, "person_", randomBelow(people));
+    if (kind == 2){
+        printf("%s where ?\n", name);
+    }
+    else if (kind == 3){
+        printf("%s total ?\n", name);
+    }
+    else{
+        printf("%s total ", name);
+        makeName(name, "item_", randomBelow(items));
+        printf("%s ?\n", name);
+    }
+}
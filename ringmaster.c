@@ -3,1687 +3,3895 @@
  * Then we seperated those sequences into action sequences and condition sequences
  * Action sequence consists of possibly multiple actions that will be processed together depending on its condition sequence
  * Questions are handled separately only by reading data word by word
- * The data will be stored in a People array which stores all the Person instances
+ * The data is stored in a Person_Registry, parallel arrays of names, ranks, locations and inventories indexed by the handle of
+ * each person, and the amounts of every item are also kept in a column per item for the total questions (see structs.h)
  */
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <pthread.h>
+#include <errno.h>
+#include <signal.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 #include "structs.h"
 
 #define INITIAL_ARRAY_SIZE 10
-bool hasDuplicates(char **strArray, int size);
-struct Person *findPerson (struct Person ***people, char *name, int *people_count, int *array_size);
+#define INITIAL_SLOT_COUNT 64 // must be a power of two
+#define INITIAL_ITEM_SLOT_COUNT 16 // must be a power of two
+#define NOWHERE_SYMBOL 0 // "NOWHERE" is the first string interned
+#define ARENA_BLOCK_SIZE 65536 // size of the first arena block in bytes
+#define ARENA_ALIGNMENT 16 // every arena allocation is aligned to this many bytes
+#define OUTPUT_BUFFER_SIZE 1048576 // size of the output buffer, in block mode it is written when it is full
+#define INPUT_BUFFER_SIZE 65536 // initial size of the input buffer, it grows for longer lines
+#define PLAN_CACHE_CAPACITY 4096 // default number of cached plans
+#define SNAPSHOT_MAGIC "RMSNAP2" // first bytes of a snapshot file, the number changes with the format
+#define JOURNAL_BUFFER_SIZE 65536 // initial size of the buffer of statements that are not written to the journal yet
+#define JOURNAL_GROUP_COMMIT 64 // default number of statements that are synced to the journal together
+#define JOURNAL_CHECKPOINT_INTERVAL 1000000 // default number of journaled statements between checkpoints
+#define PARALLEL_WINDOW_SIZE 4096 // statements that are scheduled together in a parallel batch
+#define CAPTURE_BUFFER_SIZE 256 // initial size of the buffer of a captured response
+#define SERVER_EVENT_COUNT 64 // events handled after each epoll_wait
+#define SERVER_OUTPUT_LIMIT 1048576 // a client is not read from while this many bytes of its responses are not sent
+// Pointers, counts and hash slots that reader threads read while the writer changes the world are stored with PUBLISH
+// after what they point to or count is filled, and loaded with ACQUIRE, see answerConcurrently
+#define PUBLISH(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define ACQUIRE(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+
+struct Symbol_Table *symbol_table; // interned names, items and locations shared by the whole program
+// Worker threads of a parallel batch have their own arena and write responses into their own output
+_Thread_local struct Arena *arena; // memory of the statement being parsed and executed, it is reset after every statement
+_Thread_local struct Output *output; // buffer every response is written into before it is written to stdout
+struct Plan_Cache *plan_cache; // plans of recently seen action sentences, NULL if caching is disabled
+struct Prepared_Table *prepared_table; // statements registered with "prepare"
+struct Journal *journal; // NULL unless --journal is given
+volatile sig_atomic_t server_stopping; // set by SIGINT and SIGTERM in server mode
+struct Readers *readers; // threads that answer questions in server mode, NULL unless --readers is given
+unsigned long world_version; // odd while the writer changes the world, see beginWrite
+long long world_epoch = 1; // advanced when retired arrays are reclaimed, 0 means a reader is not reading
+int write_depth; // nesting of beginWrite
+bool shared_totals; // workers of a parallel batch change the totals of items at the same time, see addTotal
+bool atomic_statements; // --atomic: an action that fails takes back the earlier actions of its statement too, see executePlan
+_Thread_local bool world_reader; // the thread answers questions concurrently with the writer and must not change the world
+_Thread_local bool torn_read; // a reader did not find someone because the writer changed the world meanwhile
+
+// Building with -DBENCHMARK (make benchmark) measures the latency of every phase of every statement
+// and prints the throughput and latency percentiles to stderr at exit, otherwise the measurements compile to nothing
+#ifdef BENCHMARK
+_Thread_local struct Phase_Samples phase_samples[PHASE_COUNT]; // only the main thread is measured in a parallel batch
+char *phase_names[PHASE_COUNT] = {"plan lookup", "lexing", "parsing", "conditions", "processAction", "questions"};
+long long statement_count = 0;
+#define BENCHMARK_START(name) long long name = benchmarkClock()
+#define BENCHMARK_RECORD(phase, start) recordSample(&phase_samples[phase], benchmarkClock() - (start))
+#else
+#define BENCHMARK_START(name)
+#define BENCHMARK_RECORD(phase, start)
+#endif
+
+struct Symbol_Table *initializeSymbolTable();
+int internString(char *str);
+int lookupSymbol(char *str);
+char *symbolName(int id);
+void growSymbolSlots(struct Symbol_Table *table);
+
+struct Arena *initializeArena();
+struct Arena_Block *createArenaBlock(size_t size);
+void *arenaAlloc(size_t size);
+void *arenaGrow(void *memory, size_t old_size, size_t new_size);
+void resetArena();
+
+bool hasDuplicates(int *idArray, int size);
+int findPerson(struct Person_Registry *registry, int name);
+int resolvePerson(struct Person_Registry *registry, int name);
+int usePerson(struct Person_Registry *registry, int handle);
+int lookupPerson(struct Person_Registry *registry, int name);
+
+
+
+
+bool checkConditionSequence(struct Plan_Sequence *sequence, struct Person_Registry *registry);
+bool primitiveCondition(struct Person_Registry *registry, int person, enum Condition_Mode mode, int object, int count);
+
+void executePlan(struct Plan *plan, struct Person_Registry *registry);
+bool processActionSequence(struct Plan_Sequence *sequence, struct Person_Registry *registry, struct Undo_Log *log);
+bool processAction(struct Plan_Action *action, struct Person_Registry *registry, struct Undo_Log *log);
+void primitiveAction(struct Person_Registry *registry, struct Undo_Log *log, int person, enum Action_Mode mode, int num, int object);
+bool sellItem(struct Person_Registry *registry, struct Undo_Log *log, int person, int item, long long amount);
+struct Undo_Entry *logChange(struct Undo_Log *log, enum Undo_Kind kind, int person);
+void rollback(struct Person_Registry *registry, struct Undo_Log *log, int savepoint);
+void removeLastItem(struct Inventory *inventory);
+
+
+
+struct Person_Registry *initializeRegistry();
+void createPerson(struct Person_Registry *registry, int name);
+void growRegistrySlots(struct Person_Registry *registry);
+unsigned int hashString(char *str);
+unsigned int hashId(int id);
+int *allocateSlots(int slot_count);
+void insertSlot(int *slots, int slot_count, unsigned int hash, int value);
+void growItemSlots(struct Inventory *inventory);
+void addItem(struct Inventory *inventory, int item, int amount, int row);
+void who_at(struct Person_Registry *registry, int location);
+void movePerson(struct Person_Registry *registry, int person, int location);
+int findResident(struct Person_Registry *registry, struct Residents *residents, int rank);
+void moveHandles(int *handles, int to, int from, int count);
+int getItemNumber(struct Inventory *inventory, int item);
+int getItemIndex(struct Inventory *inventory, int item);
+
+int getNum(struct Token *token);
+struct Action *initializeAction();
+struct Condition *initializeCondition();
+void actionAddSubject(struct Action *action, char *subject);
+void actionAddObject(struct Action *action, char *object, int amount);
+void conditionAddObject(struct Condition *condition, char *object, int amount);
+struct Action_Sequence *initializeActionSequence();
+struct Condition_Sequence *initializeConditionSequence();
+struct Sentence *initializeSentence();
+void sequenceAddAction(struct Action_Sequence *sequence, struct Action *action);
+void sequenceAddCondition(struct Condition_Sequence *sequence, struct Condition *condition);
+void addActionSequence(struct Sentence *sentence, struct Action_Sequence *sequence);
+void addConditionSequence(struct Sentence *sentence, struct Condition_Sequence *sequence);
+bool checkFormat(struct Token *token);
+
+bool parseSentence(struct Lexer *lexer, struct Sentence *sentence);
+bool parseActionSequence(struct Lexer *lexer, struct Sentence *sentence, struct Action *action, bool *conditional);
+bool parseConditionSequence(struct Lexer *lexer, struct Sentence *sentence, struct Action **next_action);
+bool parseSubjects(struct Lexer *lexer, struct Action *action);
+bool parseActionBody(struct Lexer *lexer, struct Action *action);
+bool parseConditionBody(struct Lexer *lexer, struct Condition *condition);
+bool parseItems(struct Lexer *lexer, struct Action *action, struct Condition *condition);
+bool sentenceHasDuplicates(struct Sentence *sentence);
+
+struct Plan *compilePlan(struct Sentence *sentence, struct Lexer *lexer, struct Person_Registry *registry, struct Prepared *prepared);
+unsigned int hashStatement(char *line, bool *question, int *token_count);
+bool sameStatement(char *line, char *text);
+struct Plan_Cache *initializePlanCache(int capacity);
+struct Plan *lookupPlan(struct Plan_Cache *cache, char *line, unsigned int hash);
+void insertPlan(struct Plan_Cache *cache, struct Plan *plan);
+void unlinkPlan(struct Plan_Cache *cache, struct Plan *plan);
+void growPlanBuckets(struct Plan_Cache *cache);
+
+bool checkName(struct Lexer *lexer, struct Token *token);
+int parseAmount(struct Lexer *lexer, struct Token *token);
+bool startsItem(struct Lexer *lexer, int offset);
+bool checkParameter(struct Token *token);
+struct Prepared_Table *initializePreparedTable();
+int findPrepared(struct Prepared_Table *table, int name);
+bool prepareStatement(struct Person_Registry *registry, struct Lexer *lexer);
+bool executePrepared(struct Person_Registry *registry, struct Lexer *lexer);
+bool addParameterSite(struct Prepared *prepared, int *target, enum Site_Kind kind, int symbol);
+bool planHasDuplicates(struct Plan *plan, struct Person_Registry *registry);
+
+struct Lexer *initializeLexer();
+void tokenizeLine(struct Lexer *lexer, char *line);
+struct Token *nextToken(struct Lexer *lexer);
+struct Token *peekToken(struct Lexer *lexer, int offset);
+enum Keyword getKeyword(char *text, int length);
+
+void freeInventory(struct Inventory *inventory);
+void reservePlanRows(struct Person_Registry *registry, struct Plan *plan);
+int reserveRow(struct Person_Registry *registry, int item, int handle);
+int findRow(struct Item_Column *column, int handle);
+void growColumnSlots(struct Item_Column *column);
+void reservePlace(struct Person_Registry *registry, int location);
+void changeAmount(struct Person_Registry *registry, int person, int index, int amount);
+void addTotal(long long *total, int amount);
+long long sumColumn(int *amounts, int count);
+void freeColumn(struct Item_Column *column);
+void freeRegistry(struct Person_Registry *registry);
+void freeSymbolTable(struct Symbol_Table *table);
+void freeLexer(struct Lexer *lexer);
+void freeArena(struct Arena *arena);
+void freeInputReader(struct Input_Reader *reader);
+void freePlanCache(struct Plan_Cache *cache);
+void freePrepared(struct Prepared *prepared);
+void freePreparedTable(struct Prepared_Table *table);
+
+void runInteractive(struct Person_Registry *registry, struct Lexer *lexer);
+void processStream(struct Person_Registry *registry, struct Lexer *lexer, struct Input_Reader *reader, bool prompt);
+struct Input_Reader *initializeInputReader(int fd);
+char *readLine(struct Input_Reader *reader);
+int runBatch(struct Person_Registry *registry, struct Lexer *lexer, char *path, int thread_count);
+struct Parallel *initializeParallel(struct Person_Registry *registry, int thread_count);
+bool scheduleStatement(struct Parallel *parallel, struct Lexer *lexer, char *line);
+bool planIsRanked(struct Person_Registry *registry, struct Plan *plan);
+bool questionIsIndependent(struct Person_Registry *registry, struct Lexer *lexer);
+int personLevel(struct Parallel *parallel, int handle, bool write, int level, bool update);
+int planLevel(struct Parallel *parallel, struct Plan *plan, int level, bool update);
+int questionLevel(struct Parallel *parallel, struct Lexer *lexer, int level, bool update);
+void runWindow(struct Parallel *parallel);
+void executeLevels(struct Parallel *parallel);
+void *workerThread(void *argument);
+void freeParallel(struct Parallel *parallel);
+int runServer(struct Person_Registry *registry, struct Lexer *lexer, char *address, int reader_count);
+int openListener(char *address);
+void acceptClients(struct Server *server);
+void serveConnection(struct Server *server, struct Person_Registry *registry, struct Lexer *lexer, struct Connection *connection, unsigned int events);
+bool receiveStatements(struct Input_Reader *reader);
+bool processConnection(struct Person_Registry *registry, struct Lexer *lexer, struct Connection *connection);
+char *bufferedLine(struct Input_Reader *reader);
+bool sendResponses(struct Connection *connection);
+void holdResponses(struct Server *server, struct Connection *connection);
+void releaseResponses(struct Server *server, struct Person_Registry *registry, struct Lexer *lexer);
+void closeConnection(struct Server *server, struct Connection *connection);
+void stopServer(int signal_number);
+void freeConnection(struct Connection *connection);
+void freeServer(struct Server *server);
+struct Readers *initializeReaders(struct Person_Registry *registry, int thread_count);
+void *readerThread(void *argument);
+void answerConcurrently(struct Readers *pool, struct Question_Job *job, int index);
+void wakeServer(struct Readers *pool);
+bool dispatchQuestion(struct Person_Registry *registry, struct Connection *connection, char *line);
+void completeQuestions(struct Server *server, struct Person_Registry *registry, struct Lexer *lexer);
+void beginWrite();
+void endWrite();
+void *growShared(void *pointer, size_t old_size, size_t new_size);
+void retireShared(void *pointer);
+void reclaimRetired(struct Readers *pool);
+void freeReaders(struct Readers *pool);
+bool saveSnapshot(struct Person_Registry *registry, char *path, long long journal_epoch);
+bool loadSnapshot(struct Person_Registry *registry, char *path, long long *journal_epoch);
+struct Journal *openJournal(struct Person_Registry *registry, struct Lexer *lexer, char *path, int group_commit, long long checkpoint_interval);
+bool replayJournal(struct Person_Registry *registry, struct Lexer *lexer, struct Journal *journal);
+void appendJournal(struct Journal *journal, char *line);
+void commitJournal(struct Journal *journal);
+void journalApplied(struct Person_Registry *registry, struct Journal *journal, int count);
+void checkpointJournal(struct Person_Registry *registry, struct Journal *journal);
+bool rewriteJournal(struct Journal *journal);
+void freeJournal(struct Journal *journal);
+bool processStatement(struct Person_Registry *registry, struct Lexer *lexer, char *line);
+bool executeStatement(struct Person_Registry *registry, struct Lexer *lexer, char *line, bool *applied);
+bool isPrepareCommand(struct Lexer *lexer);
+bool isExecuteCommand(struct Lexer *lexer);
+void answerQuestion(struct Person_Registry *registry, struct Lexer *lexer);
+void answerAggregate(struct Person_Registry *registry, struct Lexer *lexer);
+int questionSymbol(char *text);
+int questionSubject(struct Person_Registry *registry, int name);
+struct Output *initializeOutput(int fd, enum Flush_Mode mode);
+void writeBytes(char *bytes, size_t length);
+void writeString(char *str);
+void writeNumber(int number);
+void writeLongNumber(long long number);
+void endResponse();
+void flushOutput();
+bool writeAll(int fd, char *bytes, size_t length);
+bool syncDirectory(char *path);
+void freeOutput(struct Output *output);
+
+#ifdef BENCHMARK
+long long benchmarkClock();
+void recordSample(struct Phase_Samples *phase, long long nanoseconds);
+int compareSamples(const void *first, const void *second);
+void printBenchmark(long long elapsed);
+#endif
+
+
+int main(int argc, char *argv[]){
+    // Allocate the symbol table for names, items and locations and the registry that we will store our location and items data in
+    initializeSymbolTable();
+    initializeArena();
+    struct Person_Registry *registry = initializeRegistry();
+    struct Lexer *lexer = initializeLexer();
+    char *script = NULL; // statements are read from this file without prompts in batch mode
+    char *listen_address = NULL; // statements are received from clients of this socket in server mode
+    char *load_path = NULL; // snapshot the world is loaded from before the first statement
+    char *save_path = NULL; // snapshot the world is saved to after the last statement
+    char *journal_path = NULL; // journal that makes every change durable, see openJournal
+    int group_commit = JOURNAL_GROUP_COMMIT;
+    long long checkpoint_interval = JOURNAL_CHECKPOINT_INTERVAL;
+    int flush_mode = -1; // by default the output is flushed per line in interactive mode and per block in batch mode
+    int plan_cache_capacity = PLAN_CACHE_CAPACITY; // 0 disables the plan cache
+    int thread_count = 1; // threads that execute a batch
+    int reader_count = 0; // threads that answer questions in server mode
+    bool usage = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc){
+            script = argv[++i];
+        }
+        else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc){
+            listen_address = argv[++i];
+        }
+        else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc){
+            load_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc){
+            save_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc){
+            journal_path = argv[++i];
+        }
+        else if (strncmp(argv[i], "--group-commit=", 15) == 0 && atoi(argv[i] + 15) > 0){
+            group_commit = atoi(argv[i] + 15);
+        }
+        else if (strncmp(argv[i], "--checkpoint=", 13) == 0 && isdigit(argv[i][13])){
+            checkpoint_interval = atoll(argv[i] + 13);
+        }
+        else if (strcmp(argv[i], "--flush=line") == 0){
+            flush_mode = FLUSH_PER_LINE;
+        }
+        else if (strcmp(argv[i], "--flush=block") == 0){
+            flush_mode = FLUSH_PER_BLOCK;
+        }
+        else if (strncmp(argv[i], "--plan-cache=", 13) == 0 && isdigit(argv[i][13])){
+            plan_cache_capacity = atoi(argv[i] + 13);
+        }
+        else if (strncmp(argv[i], "--threads=", 10) == 0 && atoi(argv[i] + 10) > 0){
+            thread_count = atoi(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--readers=", 10) == 0 && isdigit(argv[i][10])){
+            reader_count = atoi(argv[i] + 10);
+        }
+        else if (strcmp(argv[i], "--atomic") == 0){
+            atomic_statements = true;
+        }
+        else{
+            usage = true;
+        }
+    }
+    if (journal_path != NULL && load_path != NULL){ // the journal has its own snapshot
+        usage = true;
+    }
+    if (script != NULL && listen_address != NULL){
+        usage = true;
+    }
+    if (flush_mode == -1){
+        flush_mode = script != NULL ? FLUSH_PER_BLOCK : FLUSH_PER_LINE;
+    }
+    initializeOutput(STDOUT_FILENO, flush_mode);
+    if (plan_cache_capacity > 0){
+        plan_cache = initializePlanCache(plan_cache_capacity);
+    }
+    prepared_table = initializePreparedTable();
+
+    int status = 0;
+#ifdef BENCHMARK
+    long long benchmark_start = benchmarkClock();
+#endif
+    if (usage){
+        fprintf(stderr, "usage: %s [--batch script.txt | --listen [host:]port|socket-path] [--flush=line|--flush=block]\n"
+                "       [--plan-cache=N] [--threads=N] [--readers=N] [--atomic] [--load snapshot] [--save snapshot]\n"
+                "       [--journal file [--group-commit=N] [--checkpoint=N]]\n", argv[0]);
+        status = 1;
+    }
+    else if (load_path != NULL && !loadSnapshot(registry, load_path, NULL)){
+        status = 1;
+    }
+    else if (journal_path != NULL && (journal = openJournal(registry, lexer, journal_path, group_commit, checkpoint_interval)) == NULL){
+        status = 1;
+    }
+    else if (script != NULL){
+        status = runBatch(registry, lexer, script, thread_count);
+    }
+    else if (listen_address != NULL){
+        status = runServer(registry, lexer, listen_address, reader_count);
+    }
+    else{
+        runInteractive(registry, lexer);
+    }
+    if (status == 0 && save_path != NULL && !saveSnapshot(registry, save_path, 0)){
+        status = 1;
+    }
+    freeJournal(journal); // the statements that are still pending are committed
+    journal = NULL; // before the output is flushed for the last time, see flushOutput
+#ifdef BENCHMARK
+    flushOutput(); // writing the output is part of the run
+    printBenchmark(benchmarkClock() - benchmark_start);
+#endif
+
+    // free the allocated memory
+    freeRegistry(registry);
+    freeSymbolTable(symbol_table);
+    freeArena(arena);
+    freeLexer(lexer);
+    freeOutput(output);
+    freePlanCache(plan_cache);
+    freePreparedTable(prepared_table);
+    return status;
+}
+
+// Reads statements from the standard input after a ">> " prompt until "exit"
+void runInteractive(struct Person_Registry *registry, struct Lexer *lexer){
+    struct Input_Reader *reader = initializeInputReader(STDIN_FILENO);
+    processStream(registry, lexer, reader, true);
+    freeInputReader(reader);
+}
+
+// Processes every line of a script until the end of the file or "exit" and returns the exit status
+// Regular files are memory mapped and split into lines in place, other files (pipes) are streamed
+// Prompts are not printed. With more than one thread the statements of a mapped file are executed in parallel, see scheduleStatement
+int runBatch(struct Person_Registry *registry, struct Lexer *lexer, char *path, int thread_count){
+    int fd = open(path, O_RDONLY);
+    if (fd == -1){
+        perror(path);
+        return 1;
+    }
+
+    struct stat file_stat;
+    char *data = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0){
+        size = file_stat.st_size;
+        // a private mapping is copy on write so the lines can be terminated in place
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    if (data == MAP_FAILED){
+        struct Input_Reader *reader = initializeInputReader(fd);
+        processStream(registry, lexer, reader, false);
+        freeInputReader(reader);
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    struct Parallel *parallel = thread_count > 1 ? initializeParallel(registry, thread_count) : NULL;
+    char *line = data;
+    char *end = data + size;
+    while (line < end){
+        char *newline = memchr(line, '\n', end - line);
+        char *last_line = NULL;
+        if (newline != NULL){
+            *newline = '\0';
+        }
+        else{ // the last line does not end with a new line character so it is copied to terminate it
+            last_line = malloc(end - line + 1);
+            memcpy(last_line, line, end - line);
+            last_line[end - line] = '\0';
+        }
+        bool running;
+        if (parallel != NULL){
+            running = scheduleStatement(parallel, lexer, last_line != NULL ? last_line : line);
+            if (last_line != NULL){ // tokens of the tasks may point into the copied last line
+                runWindow(parallel);
+            }
+        }
+        else{
+            running = processStatement(registry, lexer, last_line != NULL ? last_line : line);
+        }
+        free(last_line);
+        if (!running || newline == NULL){
+            break;
+        }
+        line = newline + 1;
+    }
+    if (parallel != NULL){
+        runWindow(parallel);
+        freeParallel(parallel);
+    }
+    munmap(data, size);
+    return 0;
+}
+
+// Processes the lines of a reader until the end of the input or "exit", a ">> " prompt is shown before each line if prompt is set
+void processStream(struct Person_Registry *registry, struct Lexer *lexer, struct Input_Reader *reader, bool prompt){
+    while(1){
+        if (prompt){
+            writeString(">> ");
+            flushOutput(); // the prompt is shown before reading even if the output is flushed per block
+        }
+        char *line = readLine(reader);
+        if (line == NULL){ // end of the input
+            break;
+        }
+        if (!processStatement(registry, lexer, line)){
+            break;
+        }
+    }
+}
+
+// Constructor of an input reader that reads lines of any length from fd
+struct Input_Reader *initializeInputReader(int fd){
+    struct Input_Reader *reader = calloc(1, sizeof(struct Input_Reader));
+    reader->fd = fd;
+    reader->start = 0;
+    reader->end = 0;
+    reader->capacity = INPUT_BUFFER_SIZE;
+    reader->buffer = malloc(reader->capacity);
+    reader->eof = false;
+    return reader;
+}
+
+// Serves clients on a TCP or UNIX socket until SIGINT or SIGTERM, every client changes and asks about the same world
+// A client sends statements one per line and gets the responses in the same order, it may send many statements
+// without waiting for their responses. "exit" closes only its own connection. Prepared statements are shared by every client
+// Statements are processed one at a time by this thread so they see each other in the order they were received
+// With reader threads, questions that do not change the world are answered by them while this thread goes on, see dispatchQuestion
+int runServer(struct Person_Registry *registry, struct Lexer *lexer, char *address, int reader_count){
+    int listen_fd = openListener(address);
+    if (listen_fd == -1){
+        return 1;
+    }
+    struct Server *server = calloc(1, sizeof(struct Server));
+    server->listen_fd = listen_fd;
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->connection_array_size = INITIAL_ARRAY_SIZE;
+    server->connections = calloc(server->connection_array_size, sizeof(struct Connection*));
+    server->connection_count = 0;
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = listen_fd};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    if (reader_count > 0){
+        initializeReaders(registry, reader_count);
+        struct epoll_event answered = {.events = EPOLLIN, .data.fd = readers->event_fd};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, readers->event_fd, &answered);
+    }
+
+    struct sigaction action = {0};
+    action.sa_handler = stopServer; // without SA_RESTART so that epoll_wait returns
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct epoll_event events[SERVER_EVENT_COUNT];
+    while (!server_stopping){
+        // The journal is committed when there is nothing else to do, so a busy server still syncs once per group_commit statements
+        bool pending = journal != NULL && journal->pending > 0;
+        int count = epoll_wait(server->epoll_fd, events, SERVER_EVENT_COUNT, pending ? 0 : -1);
+        if (count == 0 && pending){
+            commitJournal(journal);
+            releaseResponses(server, registry, lexer);
+            continue;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.fd == listen_fd){
+                acceptClients(server);
+            }
+            else if (readers != NULL && events[i].data.fd == readers->event_fd){
+                completeQuestions(server, registry, lexer);
+            }
+            else{
+                serveConnection(server, registry, lexer, server->connections[events[i].data.fd], events[i].events);
+            }
+        }
+        if (server->holding && journal->pending == 0){ // the group was committed when a statement filled it
+            releaseResponses(server, registry, lexer);
+        }
+    }
+    if (strchr(address, '/') != NULL){
+        unlink(address);
+    }
+    freeReaders(readers); // before the connections their questions belong to
+    readers = NULL;
+    freeServer(server);
+    return 0;
+}
+
+// Opens a non-blocking listening socket, the address is a path of a UNIX socket if it has a '/',
+// otherwise it is "port" or "host:port" of a TCP socket. returns -1 if it could not be opened
+int openListener(char *address){
+    if (strchr(address, '/') != NULL){
+        struct sockaddr_un local = {.sun_family = AF_UNIX};
+        if (strlen(address) >= sizeof(local.sun_path)){
+            fprintf(stderr, "%s: path is too long for a socket\n", address);
+            return -1;
+        }
+        strcpy(local.sun_path, address);
+        struct stat info;
+        if (stat(address, &info) == 0 && S_ISSOCK(info.st_mode)){ // left by a server that did not stop cleanly
+            unlink(address);
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr *) &local, sizeof(local)) != 0 || listen(fd, SOMAXCONN) != 0){
+            perror(address);
+            if (fd != -1){
+                close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+    // the port is after the last ':' so that IPv6 hosts can be given in brackets
+    char *host = NULL;
+    char *port = address;
+    char *colon = strrchr(address, ':');
+    char host_buffer[256];
+    if (colon != NULL){
+        int length = colon - address;
+        if (length >= 2 && address[0] == '[' && address[length - 1] == ']'){ // "[]:port" leaves an empty host
+            address++;
+            length -= 2;
+        }
+        if (length >= (int) sizeof(host_buffer)){
+            fprintf(stderr, "%s: host name is too long\n", address);
+            return -1;
+        }
+        memcpy(host_buffer, address, length);
+        host_buffer[length] = '\0';
+        host = length > 0 ? host_buffer : NULL;
+        port = colon + 1;
+    }
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE};
+    struct addrinfo *addresses;
+    int error = getaddrinfo(host, port, &hints, &addresses);
+    if (error != 0){
+        fprintf(stderr, "%s: %s\n", port, gai_strerror(error));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *candidate = addresses; candidate != NULL && fd == -1; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, candidate->ai_protocol);
+        if (fd == -1){
+            continue;
+        }
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0){
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd == -1){
+        perror(port);
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+// Accepts every client that is waiting and adds its connection to the server
+void acceptClients(struct Server *server){
+    while (true){
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd == -1){ // EAGAIN after the last waiting client
+            return;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        int no_delay = 1; // a response is sent as soon as it is ready, fails harmlessly on UNIX sockets
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        // If the array does not cover the file descriptor reallocate it
+        if (fd >= server->connection_array_size){
+            int old_size = server->connection_array_size;
+            while (fd >= server->connection_array_size){
+                server->connection_array_size *= 2;
+            }
+            server->connections = realloc(server->connections, server->connection_array_size * sizeof(struct Connection*));
+            memset(&server->connections[old_size], 0, (server->connection_array_size - old_size) * sizeof(struct Connection*));
+        }
+        struct Connection *connection = calloc(1, sizeof(struct Connection));
+        connection->fd = fd;
+        connection->reader = initializeInputReader(fd);
+        struct Output *standard_output = output;
+        connection->output = initializeOutput(fd, FLUSH_CAPTURE); // responses are sent by sendResponses
+        output = standard_output;
+        connection->sent = 0;
+        connection->durable = 0;
+        connection->closing = false;
+        connection->question = NULL;
+        connection->waiting = false;
+        connection->failed = false;
+        connection->events = EPOLLIN;
+        server->connections[fd] = connection;
+        server->connection_count++;
+        struct epoll_event event = {.events = connection->events, .data.fd = fd};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Handles the events of a connection: receives statements, processes the complete lines and sends their responses
+// The connection is closed after its last response if the client sent "exit" or closed its side,
+// or at once if its socket failed. It is never closed while a reader answers its question
+void serveConnection(struct Server *server, struct Person_Registry *registry, struct Lexer *lexer, struct Connection *connection, unsigned int events){
+    if (!connection->failed && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !connection->closing && !connection->reader->eof){
+        connection->failed = !receiveStatements(connection->reader);
+    }
+    // When every response was sent at once nothing wakes the connection again, so the lines that were left
+    // in its buffer by the output limit are processed before it waits for events
+    if (!connection->failed){
+        bool limited;
+        do {
+            limited = processConnection(registry, lexer, connection);
+            holdResponses(server, connection);
+            connection->failed = !sendResponses(connection);
+        } while (!connection->failed && limited && connection->output->length == 0);
+    }
+    if (!connection->waiting && (connection->failed || (connection->closing && connection->sent == connection->output->length))){
+        closeConnection(server, connection);
+        return;
+    }
+    if (connection->failed){ // it waits for its question without events until completeQuestions closes it
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+        return;
+    }
+    // Statements are not read while too many responses wait for a slow client, the kernel buffers make the client wait
+    unsigned int wanted = 0;
+    if (!connection->closing && !connection->waiting && !connection->reader->eof && connection->output->length - connection->sent < SERVER_OUTPUT_LIMIT){
+        wanted |= EPOLLIN;
+    }
+    if (connection->sent < connection->durable){ // held responses are sent by releaseResponses
+        wanted |= EPOLLOUT;
+    }
+    if (wanted != connection->events){
+        connection->events = wanted;
+        struct epoll_event event = {.events = wanted, .data.fd = connection->fd};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    }
+}
+
+// Reads once from a non-blocking socket into the buffer of a reader, the unfinished line is moved to the beginning of the buffer first
+// returns false if the socket failed, eof is set if the client closed its side
+bool receiveStatements(struct Input_Reader *reader){
+    if (reader->start > 0){
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end + 1 == reader->capacity){ // If buffer is full reallocate it
+        reader->capacity *= 2;
+        reader->buffer = realloc(reader->buffer, reader->capacity);
+    }
+    ssize_t count = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end - 1);
+    if (count > 0){
+        reader->end += count;
+    }
+    else if (count == 0){
+        reader->eof = true;
+    }
+    else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+        return false;
+    }
+    return true;
+}
+
+// Processes the complete lines a connection received until too many responses are waiting to be sent
+// or one of its questions is given to a reader. The responses are written into the output of the connection
+// returns true if it stopped because of the output limit, lines may still be in the buffer then
+bool processConnection(struct Person_Registry *registry, struct Lexer *lexer, struct Connection *connection){
+    struct Output *standard_output = output;
+    output = connection->output;
+    bool limited = false;
+    while (!connection->closing && !connection->waiting){
+        if (connection->output->length - connection->sent >= SERVER_OUTPUT_LIMIT){
+            limited = true;
+            break;
+        }
+        char *line = bufferedLine(connection->reader);
+        if (line == NULL){
+            connection->closing = connection->reader->eof; // the last line was processed
+            break;
+        }
+        size_t length = strlen(line);
+        if (length > 0 && line[length - 1] == '\r'){ // clients like telnet end lines with "\r\n"
+            line[length - 1] = '\0';
+        }
+        if (readers != NULL && dispatchQuestion(registry, connection, line)){
+            break;
+        }
+        connection->closing = !processStatement(registry, lexer, line);
+        if (readers != NULL){
+            reclaimRetired(readers);
+        }
+    }
+    output = standard_output;
+    return limited;
+}
+
+// returns the next complete line in the buffer of a reader without reading, or NULL if there is none
+// At the end of the input the last line does not need a new line character
+char *bufferedLine(struct Input_Reader *reader){
+    char *line = reader->buffer + reader->start;
+    char *newline = memchr(line, '\n', reader->end - reader->start);
+    if (newline != NULL){
+        *newline = '\0';
+        reader->start = newline - reader->buffer + 1;
+        return line;
+    }
+    if (!reader->eof || reader->start == reader->end){
+        return NULL;
+    }
+    reader->buffer[reader->end] = '\0'; // one byte is always kept free to terminate the last line
+    reader->start = reader->end;
+    return line;
+}
+
+// Sends as many waiting responses as the socket takes without blocking, returns false if the socket failed
+// Only the durable responses are sent, see holdResponses
+bool sendResponses(struct Connection *connection){
+    struct Output *responses = connection->output;
+    while (connection->sent < connection->durable){
+        ssize_t count = send(connection->fd, responses->buffer + connection->sent, connection->durable - connection->sent, MSG_NOSIGNAL);
+        if (count == -1){
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        connection->sent += count;
+    }
+    if (connection->sent == responses->length){ // everything is sent, the buffer is reused from the beginning
+        responses->length = 0;
+        connection->sent = 0;
+        connection->durable = 0;
+    }
+    return true;
+}
+
+// Decides which responses of a connection may be sent: with a journal they are held while any statement is not committed,
+// so a client never sees the response of a statement, or an answer that depends on one, that a crash could take back
+void holdResponses(struct Server *server, struct Connection *connection){
+    if (journal == NULL || journal->pending == 0){
+        connection->durable = connection->output->length;
+    }
+    else if (connection->durable < connection->output->length){
+        server->holding = true;
+    }
+}
+
+// Sends the held responses of every connection after the journal is committed, and processes the lines that waited for them
+void releaseResponses(struct Server *server, struct Person_Registry *registry, struct Lexer *lexer){
+    server->holding = false;
+    for (int fd = 0; fd < server->connection_array_size; ++fd) {
+        struct Connection *connection = server->connections[fd];
+        if (connection != NULL && connection->durable < connection->output->length){
+            serveConnection(server, registry, lexer, connection, 0);
+        }
+    }
+}
+
+// Closes the socket of a connection and removes it from the server
+void closeConnection(struct Server *server, struct Connection *connection){
+    server->connections[connection->fd] = NULL;
+    server->connection_count--;
+    freeConnection(connection); // closing the socket removes it from the epoll set
+}
+
+// Signal handler of SIGINT and SIGTERM, the server stops after the events it is handling
+void stopServer(int signal_number){
+    (void) signal_number;
+    server_stopping = 1;
+}
+
+// Starts the reader threads that answer questions of the server concurrently with the writer, see answerConcurrently
+struct Readers *initializeReaders(struct Person_Registry *registry, int thread_count){
+    struct Readers *new_readers = calloc(1, sizeof(struct Readers));
+    new_readers->registry = registry;
+    new_readers->thread_count = thread_count;
+    new_readers->started = 0;
+    new_readers->epochs = calloc(thread_count, sizeof(long long));
+    pthread_mutex_init(&new_readers->lock, NULL);
+    pthread_cond_init(&new_readers->ready, NULL);
+    new_readers->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    new_readers->stopping = false;
+    new_readers->retired_array_size = INITIAL_ARRAY_SIZE;
+    new_readers->retired = calloc(new_readers->retired_array_size, sizeof(void*));
+    new_readers->retired_epochs = calloc(new_readers->retired_array_size, sizeof(long long));
+    new_readers->retired_count = 0;
+    readers = new_readers; // arrays are retired instead of freed from now on
+    new_readers->threads = calloc(thread_count, sizeof(pthread_t));
+    for (int i = 0; i < thread_count; ++i) {
+        pthread_create(&new_readers->threads[i], NULL, readerThread, new_readers);
+    }
+    return new_readers;
+}
+
+// Reader threads answer the questions in the queue until the readers are freed
+void *readerThread(void *argument){
+    struct Readers *pool = argument;
+    int index = __atomic_fetch_add(&pool->started, 1, __ATOMIC_RELAXED);
+    initializeArena(); // arena and output are thread local
+    world_reader = true;
+    while (true){
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && pool->waiting_first == NULL){
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        if (pool->stopping){
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        struct Question_Job *job = pool->waiting_first;
+        pool->waiting_first = job->next;
+        if (pool->waiting_first == NULL){
+            pool->waiting_last = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        answerConcurrently(pool, job, index);
+
+        pthread_mutex_lock(&pool->lock);
+        job->next = pool->answered;
+        pool->answered = job;
+        pthread_mutex_unlock(&pool->lock);
+        wakeServer(pool);
+    }
+    freeArena(arena);
+    return NULL;
+}
+
+// Adds one to the event counter of the readers so that the server completes the answered questions
+// A write that a signal interrupts is retried, otherwise the connection of the answer would wait forever
+// EAGAIN means the counter is already far above zero, the server wakes up anyway
+void wakeServer(struct Readers *pool){
+    unsigned long long one = 1;
+    ssize_t written;
+    do {
+        written = write(pool->event_fd, &one, sizeof(one));
+    } while (written == -1 && errno == EINTR);
+}
+
+// Answers a question without locking the world: the writer makes world_version odd while it changes the world (seqlock),
+// the answer is kept only if the version was even and the same before and after it, otherwise the question is answered again
+// Arrays the writer replaces meanwhile stay allocated until this reader leaves its epoch, see reclaimRetired
+void answerConcurrently(struct Readers *pool, struct Question_Job *job, int index){
+    output = job->response;
+    while (true){
+        __atomic_store_n(&pool->epochs[index], __atomic_load_n(&world_epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+        unsigned long version = __atomic_load_n(&world_version, __ATOMIC_ACQUIRE);
+        bool consistent = false;
+        if (version % 2 == 0){
+            resetArena();
+            output->length = 0;
+            job->lexer->position = 0;
+            torn_read = false;
+            answerQuestion(pool->registry, job->lexer);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            consistent = !torn_read && __atomic_load_n(&world_version, __ATOMIC_RELAXED) == version;
+        }
+        __atomic_store_n(&pool->epochs[index], 0, __ATOMIC_RELEASE);
+        if (consistent){
+            return;
+        }
+        sched_yield(); // let the writer finish its change
+    }
+}
+
+// Hands a question of a connection to the readers, returns false if the server thread has to process the line itself
+// That is every line that is not a question and every question about someone without a rank, since answering it gives them one
+bool dispatchQuestion(struct Person_Registry *registry, struct Connection *connection, char *line){
+    bool question = false;
+    int token_count = 0;
+    hashStatement(line, &question, &token_count);
+    if (!question){
+        return false;
+    }
+    struct Question_Job *job = connection->question;
+    if (job == NULL){ // the job of a connection is reused by its next questions
+        job = calloc(1, sizeof(struct Question_Job));
+        job->connection = connection;
+        job->text_size = 0;
+        job->lexer = initializeLexer();
+        struct Output *standard_output = output;
+        job->response = initializeOutput(-1, FLUSH_CAPTURE);
+        output = standard_output;
+        connection->question = job;
+    }
+    size_t length = strlen(line);
+    if (length + 1 > job->text_size){ // the tokens point into the copy so the line can be reused by the reader
+        job->text_size = length + 1;
+        job->text = realloc(job->text, job->text_size);
+    }
+    memcpy(job->text, line, length + 1);
+    tokenizeLine(job->lexer, job->text);
+    if (!questionIsIndependent(registry, job->lexer)){
+        return false;
+    }
+    connection->waiting = true;
+    job->next = NULL;
+    pthread_mutex_lock(&readers->lock);
+    if (readers->waiting_last == NULL){
+        readers->waiting_first = job;
+    }
+    else{
+        readers->waiting_last->next = job;
+    }
+    readers->waiting_last = job;
+    pthread_cond_signal(&readers->ready);
+    pthread_mutex_unlock(&readers->lock);
+    return true;
+}
+
+// Appends the answers of the readers to their connections and continues processing the statements after them
+void completeQuestions(struct Server *server, struct Person_Registry *registry, struct Lexer *lexer){
+    // The counter is reset before the answers are taken, an answer added after them wakes the server again
+    // EAGAIN means an earlier call already reset it and took the answers it counted
+    unsigned long long count;
+    ssize_t result;
+    do {
+        result = read(readers->event_fd, &count, sizeof(count));
+    } while (result == -1 && errno == EINTR);
+    pthread_mutex_lock(&readers->lock);
+    struct Question_Job *job = readers->answered;
+    readers->answered = NULL;
+    pthread_mutex_unlock(&readers->lock);
+    while (job != NULL){
+        struct Question_Job *next = job->next; // a connection has one question at a time so the order of the list does not matter
+        struct Connection *connection = job->connection;
+        connection->waiting = false;
+        if (!connection->failed){
+            struct Output *standard_output = output;
+            output = connection->output;
+            writeBytes(job->response->buffer, job->response->length);
+            output = standard_output;
+        }
+        serveConnection(server, registry, lexer, connection, 0);
+        job = next;
+    }
+}
+
+// Begins a change of the world, readers that answer a question meanwhile answer it again, see answerConcurrently
+// Changes may be nested, only the outermost one changes the version. Without readers it does nothing
+void beginWrite(){
+    if (readers == NULL || write_depth++ > 0){
+        return;
+    }
+    __atomic_store_n(&world_version, world_version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // the odd version is visible before any change
+}
+
+// Ends a change of the world that beginWrite began
+void endWrite(){
+    if (readers == NULL || --write_depth > 0){
+        return;
+    }
+    __atomic_store_n(&world_version, world_version + 1, __ATOMIC_RELEASE);
+}
+
+// realloc for arrays that readers may be reading: with readers the old array is copied and retired instead of freed
+void *growShared(void *pointer, size_t old_size, size_t new_size){
+    if (readers == NULL){
+        return realloc(pointer, new_size);
+    }
+    void *grown = malloc(new_size);
+    if (old_size > 0){
+        memcpy(grown, pointer, old_size);
+    }
+    retireShared(pointer);
+    return grown;
+}
+
+// free for arrays that readers may be reading: with readers the array is freed by reclaimRetired once no reader can still see it
+void retireShared(void *pointer){
+    if (readers == NULL || pointer == NULL){
+        free(pointer);
+        return;
+    }
+    if (readers->retired_count == readers->retired_array_size){ // If array is full reallocate it
+        readers->retired_array_size *= 2;
+        readers->retired = realloc(readers->retired, readers->retired_array_size * sizeof(void*));
+        readers->retired_epochs = realloc(readers->retired_epochs, readers->retired_array_size * sizeof(long long));
+    }
+    readers->retired[readers->retired_count] = pointer;
+    readers->retired_epochs[readers->retired_count] = __atomic_load_n(&world_epoch, __ATOMIC_SEQ_CST);
+    readers->retired_count++;
+}
+
+// Frees the retired arrays that no reader can still be reading (epoch based reclamation)
+// The epoch is advanced first, an array retired in an epoch is freed when every reader is idle or started in a later epoch
+void reclaimRetired(struct Readers *pool){
+    if (pool->retired_count == 0){
+        return;
+    }
+    long long oldest = __atomic_add_fetch(&world_epoch, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < pool->thread_count; ++i) {
+        long long epoch = __atomic_load_n(&pool->epochs[i], __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest){
+            oldest = epoch;
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < pool->retired_count; ++i) {
+        if (pool->retired_epochs[i] < oldest){
+            free(pool->retired[i]);
+        }
+        else{
+            pool->retired[kept] = pool->retired[i];
+            pool->retired_epochs[kept] = pool->retired_epochs[i];
+            kept++;
+        }
+    }
+    pool->retired_count = kept;
+}
+
+// Writes the world into a snapshot file that loadSnapshot can map at startup, returns false if it could not be written
+// The snapshot is written to path.tmp and renamed so an interrupted save never replaces a good snapshot with half of one
+bool saveSnapshot(struct Person_Registry *registry, char *path, long long journal_epoch){
+    // count everything first so that the snapshot is built in one buffer
+    struct Snapshot_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.symbol_count = symbol_table->symbol_count;
+    header.people_count = registry->people_count;
+    header.rank_count = registry->rank_count;
+    header.journal_epoch = journal_epoch;
+    for (int i = 0; i < symbol_table->symbol_count; ++i) {
+        header.string_bytes += strlen(symbol_table->strings[i]) + 1;
+    }
+    header.string_bytes = (header.string_bytes + 3) & ~3LL; // the sections after the strings are aligned for ints
+    for (int i = 0; i < registry->people_count; ++i) {
+        header.item_total += registry->inventories[i].item_count;
+    }
+    size_t size = sizeof(header) + (header.symbol_count + 1) * sizeof(int) + header.string_bytes
+            + (4 * (size_t) header.people_count + 2 * (size_t) header.item_total) * sizeof(int);
+    char *buffer = calloc(1, size);
+    memcpy(buffer, &header, sizeof(header));
+    int *offsets = (int *) (buffer + sizeof(header));
+    char *strings = (char *) (offsets + header.symbol_count + 1);
+    int *people = (int *) (strings + header.string_bytes);
+    int *items = people + 4 * header.people_count;
+    int *amounts = items + header.item_total;
+
+    int offset = 0;
+    for (int i = 0; i < symbol_table->symbol_count; ++i) {
+        offsets[i] = offset;
+        int length = strlen(symbol_table->strings[i]) + 1;
+        memcpy(strings + offset, symbol_table->strings[i], length);
+        offset += length;
+    }
+    offsets[header.symbol_count] = offset;
+    for (int i = 0; i < registry->people_count; ++i) {
+        struct Inventory *inventory = &registry->inventories[i];
+        *people++ = registry->names[i];
+        *people++ = registry->ranks[i];
+        *people++ = registry->locations[i];
+        *people++ = inventory->item_count;
+        memcpy(items, inventory->items, inventory->item_count * sizeof(int));
+        memcpy(amounts, inventory->amounts, inventory->item_count * sizeof(int));
+        items += inventory->item_count;
+        amounts += inventory->item_count;
+    }
+
+    char *temporary = malloc(strlen(path) + 5);
+    sprintf(temporary, "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool saved = fd != -1 && writeAll(fd, buffer, size) && fsync(fd) == 0;
+    if (fd != -1 && close(fd) != 0){
+        saved = false;
+    }
+    saved = saved && rename(temporary, path) == 0 && syncDirectory(path);
+    if (!saved){
+        perror(path);
+        unlink(temporary);
+    }
+    free(temporary);
+    free(buffer);
+    return saved;
+}
+
+// Loads the world from a snapshot file into an empty registry, the file is memory mapped and read in a single pass
+// so the time it takes depends on the size of the snapshot, returns false if it is not a valid snapshot
+// The epoch of the journal that continues the snapshot is returned in journal_epoch unless it is NULL
+bool loadSnapshot(struct Person_Registry *registry, char *path, long long *journal_epoch){
+    int fd = open(path, O_RDONLY);
+    if (fd == -1){
+        perror(path);
+        return false;
+    }
+    struct stat file_stat;
+    char *data = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size >= (off_t) sizeof(struct Snapshot_Header)){
+        size = file_stat.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED){
+        fprintf(stderr, "%s: not a snapshot\n", path);
+        return false;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    // check that the sections fit the file exactly before reading them
+    struct Snapshot_Header header;
+    memcpy(&header, data, sizeof(header));
+    bool valid = memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0 && header.symbol_count > 0 && header.people_count >= 0
+            && header.rank_count >= 0 && header.rank_count <= header.people_count && header.item_total >= 0
+            && header.string_bytes >= 0 && header.string_bytes % 4 == 0 && header.string_bytes <= INT_MAX
+            && sizeof(header) + (header.symbol_count + 1) * sizeof(int) + header.string_bytes
+               + (4 * (size_t) header.people_count + 2 * (size_t) header.item_total) * sizeof(int) == size;
+    if (!valid){
+        munmap(data, size);
+        fprintf(stderr, "%s: not a valid snapshot\n", path);
+        return false;
+    }
+    int *offsets = (int *) (data + sizeof(header));
+    char *strings = (char *) (offsets + header.symbol_count + 1);
+    int *people = (int *) (strings + header.string_bytes);
+    int *items = people + 4 * header.people_count;
+    int *amounts = items + header.item_total;
+
+    // Strings are interned in order so that every id in the snapshot stays the same, "NOWHERE" is already the first one
+    valid = offsets[0] == 0 && offsets[1] == sizeof("NOWHERE") && offsets[header.symbol_count] <= header.string_bytes
+            && strcmp(strings, "NOWHERE") == 0;
+    for (int i = 1; valid && i < header.symbol_count; ++i) {
+        valid = offsets[i + 1] > offsets[i] && offsets[i + 1] <= offsets[header.symbol_count] && strings[offsets[i + 1] - 1] == '\0'
+                && internString(strings + offsets[i]) == i;
+    }
+
+    int *ranked = calloc(header.rank_count + 1, sizeof(int)); // handles by rank
+    memset(ranked, -1, (header.rank_count + 1) * sizeof(int));
+    int item_index = 0;
+    for (int i = 0; valid && i < header.people_count; ++i) {
+        int name = people[0], rank = people[1], location = people[2], item_count = people[3];
+        people += 4;
+        valid = name >= 0 && name < header.symbol_count && lookupPerson(registry, name) == -1 && rank >= -1 && rank < header.rank_count
+                && (rank == -1 ? location == NOWHERE_SYMBOL : ranked[rank] == -1) && location >= 0 && location < header.symbol_count
+                && item_count >= 0 && item_count <= header.item_total - item_index;
+        if (!valid){
+            break;
+        }
+        createPerson(registry, name);
+        registry->ranks[i] = rank;
+        registry->locations[i] = location;
+        if (rank != -1){
+            ranked[rank] = i;
+        }
+        struct Inventory *inventory = &registry->inventories[i];
+        for (int j = 0; valid && j < item_count; ++j, ++item_index) {
+            valid = items[item_index] >= 0 && items[item_index] < header.symbol_count && getItemIndex(inventory, items[item_index]) == -1;
+            if (valid){
+                // the person is at NOWHERE until the locations are filled below, movePerson adds the amounts to the place
+                int row = reserveRow(registry, items[item_index], i);
+                addItem(inventory, items[item_index], amounts[item_index], row);
+                registry->columns[items[item_index]]->amounts[row] = amounts[item_index];
+            }
+        }
+    }
+    // The total of everyone is the sum of the column once every row is filled
+    for (int item = 0; valid && item < registry->column_array_size; ++item) {
+        if (registry->columns[item] != NULL){
+            registry->columns[item]->total = sumColumn(registry->columns[item]->amounts, registry->columns[item]->row_count);
+        }
+    }
+    // People are added to their locations in the order of their ranks so the residents stay sorted without moving any handle
+    for (int rank = 0; valid && rank < header.rank_count; ++rank) {
+        valid = ranked[rank] != -1;
+        if (valid){
+            int location = registry->locations[ranked[rank]];
+            registry->locations[ranked[rank]] = NOWHERE_SYMBOL;
+            if (location != NOWHERE_SYMBOL){
+                reservePlace(registry, location);
+            }
+            movePerson(registry, ranked[rank], location);
+        }
+    }
+    registry->rank_count = header.rank_count;
+    if (journal_epoch != NULL){
+        *journal_epoch = header.journal_epoch;
+    }
+    free(ranked);
+    munmap(data, size);
+    if (!valid){
+        fprintf(stderr, "%s: not a valid snapshot\n", path);
+    }
+    return valid;
+}
+
+// Opens the journal of --journal, the snapshot of its last checkpoint is loaded and the statements journaled after it are replayed
+// without their responses, every statement that changes the world is appended to it afterwards
+// returns NULL if the journal or its snapshot could not be read
+struct Journal *openJournal(struct Person_Registry *registry, struct Lexer *lexer, char *path, int group_commit, long long checkpoint_interval){
+    struct Journal *new_journal = calloc(1, sizeof(struct Journal));
+    new_journal->path = path;
+    new_journal->snapshot_path = malloc(strlen(path) + sizeof(".snapshot"));
+    sprintf(new_journal->snapshot_path, "%s.snapshot", path);
+    new_journal->length = 0;
+    new_journal->capacity = JOURNAL_BUFFER_SIZE;
+    new_journal->buffer = malloc(new_journal->capacity);
+    new_journal->fd = -1;
+    new_journal->epoch = 0;
+    new_journal->pending = 0;
+    new_journal->group_commit = group_commit;
+    new_journal->since_checkpoint = 0;
+    new_journal->checkpoint_interval = checkpoint_interval;
+    if (access(new_journal->snapshot_path, F_OK) == 0 && !loadSnapshot(registry, new_journal->snapshot_path, &new_journal->epoch)){
+        freeJournal(new_journal);
+        return NULL;
+    }
+    if (!replayJournal(registry, lexer, new_journal)){
+        freeJournal(new_journal);
+        return NULL;
+    }
+    return new_journal;
+}
+
+// Replays the journal file, its first line is "#epoch N" and every other line is a statement
+// The first line ends with " atomic" if the statements were executed with --atomic, they are only replayed the same way
+// A journal of an older epoch than the snapshot is left by a checkpoint that was interrupted after saving the snapshot,
+// its statements are already in the snapshot so only its prepared statements are replayed
+// A last line without a new line character was not completely written before a crash so it is dropped
+bool replayJournal(struct Person_Registry *registry, struct Lexer *lexer, struct Journal *journal){
+    int fd = open(journal->path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd == -1){
+        perror(journal->path);
+        return false;
+    }
+    journal->fd = fd;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0){
+        perror(journal->path);
+        return false;
+    }
+    size_t size = file_stat.st_size;
+    size_t replayed_length = 0; // the journal is kept up to the end of the last complete statement
+    if (size > 0){
+        // a private mapping is copy on write so the lines can be terminated in place
+        char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED){
+            perror(journal->path);
+            return false;
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+        long long epoch = -1;
+        char *line = memchr(data, '\n', size);
+        if (line == NULL || sscanf(data, "#epoch %lld", &epoch) != 1 || epoch > journal->epoch){
+            munmap(data, size);
+            fprintf(stderr, "%s: not a journal of %s\n", journal->path, journal->snapshot_path);
+            return false;
+        }
+        bool atomic = line - data >= 7 && memcmp(line - 7, " atomic", 7) == 0;
+        if (atomic != atomic_statements){
+            munmap(data, size);
+            fprintf(stderr, "%s: the journal was written %s --atomic\n", journal->path, atomic_statements ? "without" : "with");
+            return false;
+        }
+        line++;
+        // responses of replayed statements are discarded by writing them to an invalid file descriptor
+        struct Output *real_output = output;
+        initializeOutput(-1, FLUSH_PER_BLOCK);
+        char *end = data + size;
+        while (line < end){
+            char *newline = memchr(line, '\n', end - line);
+            if (newline == NULL){
+                break;
+            }
+            *newline = '\0';
+            if (epoch == journal->epoch){
+                processStatement(registry, lexer, line);
+            }
+            else{
+                resetArena();
+                tokenizeLine(lexer, line);
+                if (isPrepareCommand(lexer)){
+                    prepareStatement(registry, lexer);
+                }
+            }
+            line = newline + 1;
+        }
+        freeOutput(output);
+        output = real_output;
+        if (epoch == journal->epoch){
+            replayed_length = line - data;
+        }
+        munmap(data, size);
+    }
+    if (replayed_length == 0){ // the journal is new or older than the snapshot
+        return rewriteJournal(journal);
+    }
+    if (replayed_length < size && ftruncate(fd, replayed_length) != 0){
+        perror(journal->path);
+        return false;
+    }
+    return true;
+}
+
+// Appends a statement to the journal buffer, the buffer is doubled if it does not fit
+void appendJournal(struct Journal *journal, char *line){
+    size_t length = strlen(line);
+    while (journal->length + length + 1 > journal->capacity){ // If buffer is full reallocate it
+        journal->capacity *= 2;
+        journal->buffer = realloc(journal->buffer, journal->capacity);
+    }
+    memcpy(journal->buffer + journal->length, line, length);
+    journal->buffer[journal->length + length] = '\n';
+    journal->length += length + 1;
+}
+
+// Writes the pending statements to the journal file and waits until they are on the disk with a single fdatasync
+// so the cost of syncing is shared by group_commit statements
+void commitJournal(struct Journal *journal){
+    if (journal->pending == 0){
+        return;
+    }
+    if (!writeAll(journal->fd, journal->buffer, journal->length) || fdatasync(journal->fd) != 0){
+        perror(journal->path);
+    }
+    journal->length = 0;
+    journal->pending = 0;
+}
+
+// Counts statements that were appended to the journal, they are committed after group_commit of them
+// and a checkpoint is taken after checkpoint_interval of them
+void journalApplied(struct Person_Registry *registry, struct Journal *journal, int count){
+    journal->pending += count;
+    journal->since_checkpoint += count;
+    if (journal->pending >= journal->group_commit){
+        commitJournal(journal);
+    }
+    if (journal->checkpoint_interval > 0 && journal->since_checkpoint >= journal->checkpoint_interval){
+        checkpointJournal(registry, journal);
+    }
+}
+
+// Takes a checkpoint: the world is saved in a snapshot of the next epoch and the journal is started again
+// The snapshot is saved first, if the journal is not replaced after that openJournal sees that the journal is older than the snapshot
+void checkpointJournal(struct Person_Registry *registry, struct Journal *journal){
+    commitJournal(journal);
+    if (!saveSnapshot(registry, journal->snapshot_path, journal->epoch + 1)){
+        return;
+    }
+    journal->epoch++;
+    journal->since_checkpoint = 0;
+    rewriteJournal(journal);
+}
+
+// Replaces the journal file with one that has only the epoch line and the prepared statements, since the snapshot does not have them
+// The new journal is written to path.tmp and renamed so the old journal stays until the new one is complete
+bool rewriteJournal(struct Journal *journal){
+    char *temporary = malloc(strlen(journal->path) + 5);
+    sprintf(temporary, "%s.tmp", journal->path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    bool written = fd != -1;
+    if (written){
+        char epoch_line[40];
+        int length = sprintf(epoch_line, "#epoch %lld%s\n", journal->epoch, atomic_statements ? " atomic" : "");
+        written = writeAll(fd, epoch_line, length);
+        for (int i = 0; written && i < prepared_table->statement_count; ++i) {
+            char *text = prepared_table->statements[i]->plan->text;
+            written = writeAll(fd, text, strlen(text)) && writeAll(fd, "\n", 1);
+        }
+        written = written && fsync(fd) == 0 && rename(temporary, journal->path) == 0;
+    }
+    if (!written){
+        perror(temporary);
+        if (fd != -1){
+            close(fd);
+            unlink(temporary);
+        }
+    }
+    else{
+        close(journal->fd);
+        journal->fd = fd;
+        if (!syncDirectory(journal->path)){ // a crash may bring the old journal back, it is older than the snapshot then
+            perror(journal->path);
+        }
+    }
+    free(temporary);
+    return written;
+}
+
+// Constructor of the parallel executor, the workers are started and wait for the first window
+struct Parallel *initializeParallel(struct Person_Registry *registry, int thread_count){
+    struct Parallel *parallel = calloc(1, sizeof(struct Parallel));
+    parallel->registry = registry;
+    parallel->thread_count = thread_count;
+    parallel->stopping = false;
+    parallel->task_count = 0;
+    parallel->window_size = PARALLEL_WINDOW_SIZE;
+    parallel->tasks = calloc(parallel->window_size, sizeof(struct Task));
+    parallel->order = calloc(parallel->window_size, sizeof(int));
+    parallel->level_starts = calloc(parallel->window_size + 1, sizeof(int));
+    parallel->level_next = calloc(parallel->window_size, sizeof(int));
+    parallel->level_count = 0;
+    parallel->window = 1;
+    parallel->levels_size = 0; // the level arrays grow with the registry
+    parallel->location_read_level = -1;
+    parallel->location_write_level = -1;
+    parallel->everyone_read_level = -1;
+    parallel->everyone_write_level = -1;
+    shared_totals = true;
+    pthread_barrier_init(&parallel->barrier, NULL, thread_count);
+    parallel->workers = calloc(thread_count - 1, sizeof(pthread_t));
+    for (int i = 0; i < thread_count - 1; ++i) {
+        pthread_create(&parallel->workers[i], NULL, workerThread, parallel);
+    }
+    return parallel;
+}
+
+// Adds a statement to the window, a statement that can not run in parallel is processed serially after the window is executed
+// That is a statement that would intern a string, create a person or give someone a rank while the window runs,
+// "prepare", "execute" and "exit". returns false if the statement is "exit"
+bool scheduleStatement(struct Parallel *parallel, struct Lexer *lexer, char *line){
+    struct Person_Registry *registry = parallel->registry;
+    resetArena();
+    bool question = false;
+    int token_count = 0;
+    unsigned int hash = hashStatement(line, &question, &token_count);
+    struct Plan *plan = NULL;
+    if (!question && token_count > 0 && plan_cache != NULL){
+        plan = lookupPlan(plan_cache, line, hash);
+    }
+    bool owns_plan = false;
+    bool serial = false;
+    char *end = NULL; // end of the line before it is tokenized in place
+    if (plan == NULL && token_count > 0){
+        end = line + strlen(line);
+        tokenizeLine(lexer, line);
+        serial = (lexer->tokens[0].keyword == KEYWORD_EXIT && lexer->token_count == 1) || isPrepareCommand(lexer) || isExecuteCommand(lexer)
+                || (question && !questionIsIndependent(registry, lexer));
+        if (!serial && !question){
+            struct Sentence *sentence = initializeSentence();
+            bool invalid = !parseSentence(lexer, sentence) || sentenceHasDuplicates(sentence);
+            plan = compilePlan(invalid ? NULL : sentence, lexer, registry, NULL);
+            owns_plan = true;
+        }
+    }
+    serial = serial || (plan != NULL && !plan->invalid && !planIsRanked(registry, plan));
+    if (serial){
+        if (owns_plan){ // it is compiled again by processStatement, this only happens the first time someone is used
+            free(plan);
+        }
+        runWindow(parallel);
+        if (end != NULL){ // put the spaces that tokenizeLine replaced back
+            for (int i = 0; i < lexer->token_count; ++i) {
+                if (lexer->tokens[i].text + lexer->tokens[i].length < end){
+                    lexer->tokens[i].text[lexer->tokens[i].length] = ' ';
+                }
+            }
+        }
+        return processStatement(registry, lexer, line);
+    }
+#ifdef BENCHMARK
+    statement_count++;
+#endif
+
+    // the level of the task is one more than the highest level of the tasks before it that it conflicts with
+    if (parallel->levels_size < registry->people_count){
+        int old_size = parallel->levels_size;
+        parallel->levels_size = registry->array_size;
+        parallel->read_levels = realloc(parallel->read_levels, parallel->levels_size * sizeof(int));
+        parallel->write_levels = realloc(parallel->write_levels, parallel->levels_size * sizeof(int));
+        parallel->stamps = realloc(parallel->stamps, parallel->levels_size * sizeof(int));
+        memset(&parallel->stamps[old_size], 0, (parallel->levels_size - old_size) * sizeof(int));
+    }
+    struct Task *task = &parallel->tasks[parallel->task_count++];
+    task->plan = plan;
+    task->owns_plan = owns_plan;
+    task->is_question = question;
+    task->level = 0;
+    if (question){
+        struct Lexer *copy = &task->question;
+        if (copy->array_size < lexer->token_count){
+            copy->array_size = lexer->array_size;
+            copy->tokens = realloc(copy->tokens, copy->array_size * sizeof(struct Token));
+        }
+        memcpy(copy->tokens, lexer->tokens, lexer->token_count * sizeof(struct Token));
+        copy->token_count = lexer->token_count;
+        copy->position = 0;
+        copy->question = true;
+        task->level = questionLevel(parallel, copy, 0, false);
+        questionLevel(parallel, copy, task->level, true);
+    }
+    else if (plan != NULL && !plan->invalid){
+        task->level = planLevel(parallel, plan, 0, false);
+        planLevel(parallel, plan, task->level, true);
+    }
+    if (parallel->task_count == parallel->window_size){
+        runWindow(parallel);
+    }
+    return true;
+}
+
+// returns true if every person in a plan already has a rank, so executing it does not change the rank of anyone
+bool planIsRanked(struct Person_Registry *registry, struct Plan *plan){
+    for (int i = 0; i < plan->sequence_count; ++i) {
+        struct Plan_Sequence *sequence = &plan->sequences[i];
+        for (int j = 0; j < sequence->action_count; ++j) {
+            struct Plan_Action *action = &sequence->actions[j];
+            for (int k = 0; k < action->num_of_subjects; ++k) {
+                if (registry->ranks[action->subjects[k]] == -1){
+                    return false;
+                }
+            }
+            if (action->trader != -1 && registry->ranks[action->trader] == -1){
+                return false;
+            }
+        }
+        for (int j = 0; j < sequence->condition_count; ++j) {
+            struct Plan_Condition *condition = &sequence->conditions[j];
+            for (int k = 0; k < condition->num_of_subjects; ++k) {
+                if (registry->ranks[condition->subjects[k]] == -1){
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// returns true if a question can be answered by a worker: every name before "where" or "total" is a person with a rank
+// so answerQuestion does not intern a string, create a person or give someone a rank
+bool questionIsIndependent(struct Person_Registry *registry, struct Lexer *lexer){
+    for (int i = 0; i < lexer->token_count; ++i) {
+        struct Token *token = &lexer->tokens[i];
+        if ((token->keyword == KEYWORD_WHO && i == 0) || token->keyword == KEYWORD_WHERE || token->keyword == KEYWORD_TOTAL){
+            return true;
+        }
+        if (checkFormat(token)){
+            int name = lookupSymbol(token->text);
+            int handle = name == -1 ? -1 : lookupPerson(registry, name);
+            if (handle == -1 || registry->ranks[handle] == -1){
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// returns the lowest level a task that reads or writes a person can have after the tasks before it,
+// or records that the task at level reads or writes the person if update is set
+int personLevel(struct Parallel *parallel, int handle, bool write, int level, bool update){
+    if (parallel->stamps[handle] != parallel->window){ // the person is not touched by this window yet
+        parallel->stamps[handle] = parallel->window;
+        parallel->read_levels[handle] = -1;
+        parallel->write_levels[handle] = -1;
+    }
+    int *read_level = &parallel->read_levels[handle];
+    int *write_level = &parallel->write_levels[handle];
+    if (update){
+        if (write && *write_level < level){
+            *write_level = level;
+        }
+        else if (!write && *read_level < level){
+            *read_level = level;
+        }
+        if (write && parallel->everyone_write_level < level){
+            parallel->everyone_write_level = level;
+        }
+        return level;
+    }
+    // a write comes after every read and write, a read only after every write
+    int after = write && *read_level > *write_level ? *read_level : *write_level;
+    if (write && parallel->everyone_read_level > after){ // a total over everyone reads the person too
+        after = parallel->everyone_read_level;
+    }
+    return after + 1 > level ? after + 1 : level;
+}
+
+// The level of a plan: subjects and traders are written, subjects of conditions are read and go to writes the residents of locations
+int planLevel(struct Parallel *parallel, struct Plan *plan, int level, bool update){
+    for (int i = 0; i < plan->sequence_count; ++i) {
+        struct Plan_Sequence *sequence = &plan->sequences[i];
+        for (int j = 0; j < sequence->action_count; ++j) {
+            struct Plan_Action *action = &sequence->actions[j];
+            for (int k = 0; k < action->num_of_subjects; ++k) {
+                level = personLevel(parallel, action->subjects[k], true, level, update);
+            }
+            if (action->trader != -1){
+                level = personLevel(parallel, action->trader, true, level, update);
+            }
+            if (action->mode != ACTION_GO_TO){
+                continue;
+            }
+            if (update && parallel->location_write_level < level){
+                parallel->location_write_level = level;
+            }
+            else if (!update){
+                int after = parallel->location_read_level > parallel->location_write_level ? parallel->location_read_level : parallel->location_write_level;
+                level = after + 1 > level ? after + 1 : level;
+            }
+        }
+        for (int j = 0; j < sequence->condition_count; ++j) {
+            struct Plan_Condition *condition = &sequence->conditions[j];
+            for (int k = 0; k < condition->num_of_subjects; ++k) {
+                level = personLevel(parallel, condition->subjects[k], false, level, update);
+            }
+        }
+    }
+    return level;
+}
+
+// The level of a question: who at reads the residents of locations, a total of an item reads everyone
+// (and their locations if it is "at" a location) and other questions read their subjects
+int questionLevel(struct Parallel *parallel, struct Lexer *lexer, int level, bool update){
+    struct Person_Registry *registry = parallel->registry;
+    if (lexer->tokens[0].keyword == KEYWORD_TOTAL){
+        bool at = lexer->token_count > 2 && lexer->tokens[2].keyword == KEYWORD_AT;
+        if (update){
+            if (parallel->everyone_read_level < level){
+                parallel->everyone_read_level = level;
+            }
+            if (at && parallel->location_read_level < level){
+                parallel->location_read_level = level;
+            }
+            return level;
+        }
+        if (parallel->everyone_write_level + 1 > level){
+            level = parallel->everyone_write_level + 1;
+        }
+        if (at && parallel->location_write_level + 1 > level){
+            level = parallel->location_write_level + 1;
+        }
+        return level;
+    }
+    if (lexer->tokens[0].keyword == KEYWORD_WHO){
+        if (update && parallel->location_read_level < level){
+            parallel->location_read_level = level;
+        }
+        else if (!update && parallel->location_write_level + 1 > level){
+            level = parallel->location_write_level + 1;
+        }
+        return level;
+    }
+    for (int i = 0; i < lexer->token_count; ++i) {
+        struct Token *token = &lexer->tokens[i];
+        if (token->keyword == KEYWORD_WHERE || token->keyword == KEYWORD_TOTAL){
+            break;
+        }
+        if (checkFormat(token)){ // questionIsIndependent made sure that it is a person
+            level = personLevel(parallel, lookupPerson(registry, lookupSymbol(token->text)), false, level, update);
+        }
+    }
+    return level;
+}
+
+// Executes the window and writes the responses in the order of the statements
+// Tasks are sorted by level with a counting sort, all threads execute a level and wait for each other before the next one
+void runWindow(struct Parallel *parallel){
+    if (parallel->task_count == 0){
+        return;
+    }
+    parallel->level_count = 0;
+    for (int i = 0; i < parallel->task_count; ++i) {
+        if (parallel->tasks[i].level + 1 > parallel->level_count){
+            parallel->level_count = parallel->tasks[i].level + 1;
+        }
+    }
+    memset(parallel->level_starts, 0, (parallel->level_count + 1) * sizeof(int));
+    for (int i = 0; i < parallel->task_count; ++i) {
+        parallel->level_starts[parallel->tasks[i].level + 1]++;
+    }
+    for (int level = 0; level < parallel->level_count; ++level) {
+        parallel->level_starts[level + 1] += parallel->level_starts[level];
+        parallel->level_next[level] = parallel->level_starts[level];
+    }
+    for (int i = 0; i < parallel->task_count; ++i) {
+        parallel->order[parallel->level_next[parallel->tasks[i].level]++] = i;
+    }
+    for (int level = 0; level < parallel->level_count; ++level) {
+        parallel->level_next[level] = parallel->level_starts[level];
+    }
+
+    pthread_barrier_wait(&parallel->barrier); // release the workers
+    executeLevels(parallel);
+
+    // The statements are journaled before any response is written, flushOutput commits them before writing one
+    int applied = 0;
+    for (int i = 0; journal != NULL && i < parallel->task_count; ++i) {
+        struct Task *task = &parallel->tasks[i];
+        if (!task->is_question && task->plan != NULL && !task->plan->invalid){
+            appendJournal(journal, task->plan->text);
+            applied++;
+        }
+    }
+    if (applied > 0){
+        journalApplied(parallel->registry, journal, applied);
+    }
+    for (int i = 0; i < parallel->task_count; ++i) {
+        struct Task *task = &parallel->tasks[i];
+        if (task->is_question){
+            writeBytes(task->response->buffer, task->response->length);
+            if (output->mode == FLUSH_PER_LINE){
+                flushOutput();
+            }
+            continue;
+        }
+        writeString(task->plan == NULL || task->plan->invalid ? "INVALID" : "OK");
+        endResponse();
+    }
+    // Plans compiled in the window are cached only after every response is written since caching one may evict a plan that a task uses
+    for (int i = 0; i < parallel->task_count; ++i) {
+        struct Task *task = &parallel->tasks[i];
+        if (!task->owns_plan){
+            continue;
+        }
+        if (plan_cache != NULL && lookupPlan(plan_cache, task->plan->text, task->plan->hash) == NULL){
+            insertPlan(plan_cache, task->plan);
+        }
+        else{ // the same statement is compiled more than once in a window
+            free(task->plan);
+        }
+    }
+    parallel->task_count = 0;
+    parallel->window++;
+    parallel->location_read_level = -1;
+    parallel->location_write_level = -1;
+    parallel->everyone_read_level = -1;
+    parallel->everyone_write_level = -1;
+}
+
+// Executes every level of the window, called by the main thread and every worker
+void executeLevels(struct Parallel *parallel){
+    struct Output *thread_output = output; // the main thread writes the responses to its own output afterwards
+    int level_count = parallel->level_count; // the main thread prepares the next window once every thread passed the last barrier
+    for (int level = 0; level < level_count; ++level) {
+        int end = parallel->level_starts[level + 1];
+        while (true){
+            int index = __atomic_fetch_add(&parallel->level_next[level], 1, __ATOMIC_RELAXED);
+            if (index >= end){
+                break;
+            }
+            struct Task *task = &parallel->tasks[parallel->order[index]];
+            if (task->is_question){
+                resetArena();
+                if (task->response == NULL){ // the output of a thread is the response it is capturing
+                    task->response = initializeOutput(-1, FLUSH_CAPTURE);
+                }
+                output = task->response;
+                output->length = 0;
+                answerQuestion(parallel->registry, &task->question);
+            }
+            else if (task->plan != NULL && !task->plan->invalid){
+                executePlan(task->plan, parallel->registry);
+            }
+        }
+        pthread_barrier_wait(&parallel->barrier); // the next level may depend on every task of this one
+    }
+    output = thread_output;
+}
+
+// Worker threads execute the levels of every window until the parallel executor is freed
+void *workerThread(void *argument){
+    struct Parallel *parallel = argument;
+    initializeArena(); // arena and output are thread local
+    while (true){
+        pthread_barrier_wait(&parallel->barrier); // wait for a window
+        if (parallel->stopping){
+            break;
+        }
+        executeLevels(parallel);
+    }
+    freeArena(arena);
+    return NULL;
+}
+
+// returns the next line without its new line character or NULL at the end of the input
+// The line is terminated in place inside the buffer and stays valid until the next call
+// Only the unfinished part of a line is moved to the beginning of the buffer before reading more,
+// the buffer is doubled when a single line does not fit into it
+char *readLine(struct Input_Reader *reader){
+    size_t scanned = reader->start; // bytes before scanned do not have a new line character
+    while (true){
+        char *newline = memchr(reader->buffer + scanned, '\n', reader->end - scanned);
+        if (newline != NULL){
+            *newline = '\0';
+            char *line = reader->buffer + reader->start;
+            reader->start = newline - reader->buffer + 1;
+            return line;
+        }
+        scanned = reader->end;
+        if (reader->eof){
+            if (reader->start == reader->end){
+                return NULL;
+            }
+            // the last line does not end with a new line character, one byte is always kept free to terminate it
+            reader->buffer[reader->end] = '\0';
+            char *line = reader->buffer + reader->start;
+            reader->start = reader->end;
+            return line;
+        }
+        if (reader->start > 0){ // move the unfinished line to the beginning of the buffer
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            scanned -= reader->start;
+            reader->start = 0;
+        }
+        if (reader->end + 1 == reader->capacity){ // If buffer is full reallocate it
+            reader->capacity *= 2;
+            reader->buffer = realloc(reader->buffer, reader->capacity);
+        }
+        ssize_t count = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end - 1);
+        if (count <= 0){
+            reader->eof = true;
+        }
+        else{
+            reader->end += count;
+        }
+    }
+}
+
+// Processes one statement, returns false if the statement is "exit"
+// With a journal the statement is appended to it if it changed the world: it was an OK action sentence, prepare or execute
+// or a question gave someone a rank, since ranks decide the order of who at
+bool processStatement(struct Person_Registry *registry, struct Lexer *lexer, char *line){
+    bool applied = false;
+    if (journal == NULL){
+        return executeStatement(registry, lexer, line, &applied);
+    }
+    // the line is copied before it is tokenized in place and taken back if the statement did not change anything
+    size_t length = journal->length;
+    int rank_count = registry->rank_count;
+    appendJournal(journal, line);
+    // a response flushed per line waits until the statement is journaled, flushOutput commits it before writing the response
+    enum Flush_Mode mode = output->mode;
+    if (mode == FLUSH_PER_LINE){
+        output->mode = FLUSH_PER_BLOCK;
+    }
+    bool running = executeStatement(registry, lexer, line, &applied);
+    if (!applied && registry->rank_count == rank_count){
+        journal->length = length;
+    }
+    else{
+        journalApplied(registry, journal, 1);
+    }
+    output->mode = mode;
+    if (mode == FLUSH_PER_LINE){
+        flushOutput();
+    }
+    return running;
+}
+
+// Executes one statement and writes its response, applied is set if it was an action sentence, prepare or execute that is not INVALID
+// returns false if the statement is "exit"
+bool executeStatement(struct Person_Registry *registry, struct Lexer *lexer, char *line, bool *applied){
+#ifdef BENCHMARK
+    statement_count++;
+#endif
+    // Everything allocated for the previous statement is released at once
+    resetArena();
+    // A sentence that was seen before is executed from its cached plan without lexing and parsing it again
+    bool question = false;
+    int token_count = 0;
+    BENCHMARK_START(lookup_start);
+    unsigned int hash = hashStatement(line, &question, &token_count);
+    struct Plan *plan = NULL;
+    if (!question && token_count > 0 && plan_cache != NULL){
+        plan = lookupPlan(plan_cache, line, hash);
+    }
+    BENCHMARK_RECORD(PHASE_LOOKUP, lookup_start);
+    if (plan != NULL){
+        if (plan->invalid){
+            writeString("INVALID");
+        }
+        else{
+            executePlan(plan, registry);
+            writeString("OK");
+            *applied = true;
+        }
+        endResponse();
+        return true;
+    }
+    // a blank input is invalid
+    if (token_count == 0){
+        writeString("INVALID");
+        endResponse();
+        return true;
+    }
+    // Split the line into tokens once, the parser reads them with nextToken
+    BENCHMARK_START(lexing_start);
+    tokenizeLine(lexer, line);
+    BENCHMARK_RECORD(PHASE_LEXING, lexing_start);
+    // exit the whole process
+    if (lexer->tokens[0].keyword == KEYWORD_EXIT && lexer->token_count == 1){
+        return false;
+    }
+    // Prepared statements, "prepare name = template" and "execute name value..." are never valid sentences
+    // since a sentence can not have a name after its first subject
+    if (isPrepareCommand(lexer)){
+        BENCHMARK_START(parsing_start);
+        *applied = prepareStatement(registry, lexer);
+        BENCHMARK_RECORD(PHASE_PARSING, parsing_start);
+    }
+    else if (isExecuteCommand(lexer)){
+        *applied = executePrepared(registry, lexer);
+    }
+    // Question statements
+    else if (lexer->question){ // If it has a "?" it is a question
+        BENCHMARK_START(question_start);
+        answerQuestion(registry, lexer);
+        BENCHMARK_RECORD(PHASE_QUESTIONS, question_start);
+    }
+        // Action statements
+    else{
+        BENCHMARK_START(parsing_start);
+        struct Sentence *sentence = initializeSentence(); // the sentence is in the arena so it is not freed
+        // There should not be any duplicate items or subjects for each action and condition
+        bool invalid = !parseSentence(lexer, sentence) || sentenceHasDuplicates(sentence);
+        // INVALID sentences are cached too so that they are not parsed again
+        plan = compilePlan(invalid ? NULL : sentence, lexer, registry, NULL);
+        BENCHMARK_RECORD(PHASE_PARSING, parsing_start);
+        if (plan->invalid){
+            writeString("INVALID");
+        }
+        else{
+            executePlan(plan, registry);
+            writeString("OK");
+            *applied = true;
+        }
+        endResponse();
+        if (plan_cache != NULL){
+            insertPlan(plan_cache, plan);
+        }
+        else{
+            free(plan);
+        }
+    }
+    return true;
+}
+
+// returns true if the tokenized line is "prepare name = template"
+bool isPrepareCommand(struct Lexer *lexer){
+    struct Token *tokens = lexer->tokens;
+    return lexer->token_count >= 4 && strcmp(tokens[0].text, "prepare") == 0 && checkFormat(&tokens[1]) && strcmp(tokens[2].text, "=") == 0;
+}
+
+// returns true if the tokenized line is "execute name value..."
+bool isExecuteCommand(struct Lexer *lexer){
+    return lexer->token_count >= 2 && strcmp(lexer->tokens[0].text, "execute") == 0 && checkFormat(&lexer->tokens[1]);
+}
+
+// Answers a question statement, the line is already tokenized
+void answerQuestion(struct Person_Registry *registry, struct Lexer *lexer){
+    bool invalid = false;
+    // we used word variable to represent current word we are processing
+    struct Token *word = nextToken(lexer);
+
+    // If the question is who at the first word should be who
+    if (word->keyword == KEYWORD_WHO){
+        word = nextToken(lexer); // take the next word
+        if (word->keyword != KEYWORD_AT){ // next word should be at
+            invalid = true;
+            writeString("INVALID");
+            endResponse();
+            return;
+        }
+        // After at there should be a location
+        word = nextToken(lexer);
+
+        if (!checkFormat(word)){ // check whether location is valid or not
+            invalid = true;
+            writeString("INVALID");
+            endResponse();
+            return;
+        }
+        // If it is valid process it, a location that was never interned has nobody
+        who_at(registry, lookupSymbol(word->text));
+    }
+    else if (word->keyword == KEYWORD_TOTAL){ // "total item ?" or "total item at location ?"
+        answerAggregate(registry, lexer);
+    }
+    else{ // The questions beside who at
+        // there may be multiple subjects
+        int subject_count = 0; // The number of subjects
+        int subj_array_size = INITIAL_ARRAY_SIZE; //
+        int *subjects = arenaAlloc(subj_array_size * sizeof(int));
+        // If the first word is not who then it should be a subject
+        if (!checkFormat(word)){ // whether subject is valid or not
+            invalid = true;
+            writeString("INVALID");
+            endResponse();
+            return;
+        }
+
+        subjects[0] = questionSymbol(word->text);// If subject is valid add it to subjects array
+        subject_count++;
+        word = nextToken(lexer); // Take the second word
+
+        if (word->keyword == KEYWORD_AND){ // If there are more than one subjects the question must be in "subjects total item ?" format
+            while(true){ // Take all the subjects in the while loop
+                word = nextToken(lexer); // next subject
+                if (word == NULL || !checkFormat(word)){ // the line may end before "total", checkFormat accepts NULL
+                    invalid = true;
+                    break;
+                }
+                subjects[subject_count] = questionSymbol(word->text);
+                subject_count++;
+                // if there are not enough space in the array reallocate it
+                if (subject_count == subj_array_size){
+                    subj_array_size *= 2;
+                    subjects = arenaGrow(subjects, subj_array_size / 2 * sizeof(int), subj_array_size * sizeof(int));
+                }
+                // More than one subject is only seen total object ? question
+                word = nextToken(lexer);
+                if (word == NULL){
+                    invalid = true;
+                    break;
+                }
+                if (word->keyword == KEYWORD_TOTAL){ // If the word is total
+                    word = nextToken(lexer); // next word should be the object
+                    break; // Get out of the while loop for finding subjects
+                }
+            }
+            if(word == NULL || !checkFormat(word)){ // If the object is not valid
+                invalid = true;
+            }
+            if (invalid){
+                writeString("INVALID");
+                endResponse();
+                return;
+            }
+
+            int total = 0; // the number represents total
+            int item = lookupSymbol(word->text); // an item that was never interned is not owned by anyone
+            for (int i = 0; i < subject_count; ++i) { // For each subject
+                // find the subject and add its item number to total
+                int subject = questionSubject(registry, subjects[i]);
+                if (subject == -1){
+                    return;
+                }
+                total += getItemNumber(&ACQUIRE(registry->inventories)[subject], item);
+            }
+            word = nextToken(lexer); // "?"
+            if(word->keyword != KEYWORD_QUESTION_MARK){ // no multiple items
+                writeString("INVALID");
+                endResponse();
+                return;
+            }
+            word = nextToken(lexer);
+            if(word != NULL){ // no word must come after "?"
+                writeString("INVALID");
+                endResponse();
+                return;
+            }
+            writeNumber(total); // print out the answer
+            endResponse();
+        }
+        else if (word->keyword == KEYWORD_WHERE){ // If the question is in "subject where ?" format
+            // first find the person
+            int subject = questionSubject(registry, subjects[0]);
+            if (subject == -1){
+                return;
+            }
+            word = nextToken(lexer); // "?"
+            if(word->keyword != KEYWORD_QUESTION_MARK){
+                writeString("INVALID");
+                endResponse();
+                return;
+            }
+            word = nextToken(lexer);
+            if(word != NULL){ // no word must come after "?"
+                writeString("INVALID");
+                endResponse();
+                return;
+            }
+            writeString(symbolName(ACQUIRE(ACQUIRE(registry->locations)[subject]))); // then print its location
+            endResponse();
+        }
+            // Multiple subjects already handled so the question must be in "subject total ((optional) item) ?" format
+        else if (word->keyword == KEYWORD_TOTAL){
+            int subject = questionSubject(registry, subjects[0]);
+            if (subject == -1){
+                return;
+            }
+            struct Inventory *inventory = &ACQUIRE(registry->inventories)[subject];
+            word = nextToken(lexer); // "?"
+            if(word->keyword == KEYWORD_QUESTION_MARK){ // If there is no next word print out all the inventory of the subject
+                word = nextToken(lexer);
+                if(word != NULL){ // no word must come after "?"
+                    writeString("INVALID");
+                    endResponse();
+                    return;
+                }
+                int grand_total = 0; // total number of objects in the inventory
+                // the count is loaded before the arrays so that they hold every counted item
+                int item_count = ACQUIRE(inventory->item_count);
+                int *items = ACQUIRE(inventory->items);
+                int *amounts = ACQUIRE(inventory->amounts);
+                for (int i = 0; i < item_count; ++i) { // For each item
+                    int amount = ACQUIRE(amounts[i]); // amount of a specific item
+                    if (amount == 0){ // If the amount is 0  continue
+                        continue;
+                    }
+                    if (grand_total > 0){ // if grand total is nonzero then print "and" before the item
+                        writeString(" and ");
+                        writeNumber(amount);
+                        writeString(" ");
+                        writeString(symbolName(__atomic_load_n(&items[i], __ATOMIC_RELAXED)));
+                        grand_total += amount;
+                    }
+                    else{ // if the grant total is 0 then it is the first item
+                        writeNumber(amount);
+                        writeString(" ");
+                        writeString(symbolName(__atomic_load_n(&items[i], __ATOMIC_RELAXED)));
+                        grand_total += amount;
+                    }
+                }
+                if (grand_total == 0){ // if grand total is 0 then no item in inventory
+                    writeString("NOTHING");
+                }
+                endResponse();
+            }
+            else{   // word is item (subject total item)
+                if (!checkFormat(word)){ // check whether object is valid or not
+                    invalid = true;
+                    writeString("INVALID");
+                    endResponse();
+                    return;
+                }
+                int object = lookupSymbol(word->text); // take the object
+                word = nextToken(lexer);
+                if (word->keyword != KEYWORD_QUESTION_MARK){ // "?"
+                    invalid = true;
+                    writeString("INVALID");
+                    endResponse();
+                    return;
+                }
+                word = nextToken(lexer);
+                if (word != NULL){ // There should be nothing after "?"
+                    invalid = true;
+                    writeString("INVALID");
+                    endResponse();
+                    return;
+                }
+                writeNumber(getItemNumber(inventory, object));
+                endResponse();
+
+
+            }
+
+        }
+            // If the word is none of them then it is invalid
+        else{
+            invalid = true;
+            writeString("INVALID");
+            endResponse();
+            return;
+        }
+
+    }
+}
+
+// Answers "total item ?" with the amount everyone has and "total item at location ?" with the amount people at the location have
+// Both are running totals that actions keep up to date so nobody is looked up, "total" is already read
+void answerAggregate(struct Person_Registry *registry, struct Lexer *lexer){
+    struct Token *item = nextToken(lexer);
+    struct Token *word = nextToken(lexer);
+    struct Token *location = NULL;
+    if (item != NULL && word != NULL && word->keyword == KEYWORD_AT){
+        location = nextToken(lexer);
+        word = nextToken(lexer);
+    }
+    if (item == NULL || !checkFormat(item) || (location != NULL && !checkFormat(location)) || word == NULL
+        || word->keyword != KEYWORD_QUESTION_MARK || nextToken(lexer) != NULL){
+        writeString("INVALID");
+        endResponse();
+        return;
+    }
+    // an item that nobody ever got has no column and nobody is at a location that no plan goes to
+    int id = lookupSymbol(item->text);
+    struct Item_Column *column = id != -1 && id < ACQUIRE(registry->column_array_size) ? ACQUIRE(ACQUIRE(registry->columns)[id]) : NULL;
+    long long total = 0;
+    if (column != NULL && location == NULL){
+        total = __atomic_load_n(&column->total, __ATOMIC_RELAXED);
+    }
+    else if (column != NULL){
+        int place = lookupSymbol(location->text);
+        place = place != -1 && place < ACQUIRE(registry->places_array_size) ? ACQUIRE(ACQUIRE(registry->places)[place]) : -1;
+        // a place is numbered before the place totals of the column are loaded, so they hold it
+        total = place == -1 ? 0 : __atomic_load_n(&ACQUIRE(column->place_totals)[place], __ATOMIC_RELAXED);
+    }
+    writeLongNumber(total);
+    endResponse();
+}
+
+// returns the id of a name in a question, it is interned unless the question is answered by a reader
+int questionSymbol(char *text){
+    return world_reader ? lookupSymbol(text) : internString(text);
+}
+
+// returns the handle of the person a question asks about, it is created and given a rank unless the question is answered by a reader
+// A reader only looks the person up, if it is not found (-1) the writer changed the world meanwhile and the question is answered again
+int questionSubject(struct Person_Registry *registry, int name){
+    if (!world_reader){
+        return findPerson(registry, name);
+    }
+    int handle = name == -1 ? -1 : lookupPerson(registry, name);
+    if (handle == -1){
+        torn_read = true;
+    }
+    return handle;
+}
+
+// Parses an action sentence into its action and condition sequences, returns false if the sentence is invalid
+// The grammar is parsed by recursive descent in one pass over the tokens:
+//   sentence           := action_sequence ("if" condition_sequence)? ...
+//   action_sequence    := subjects action_body ("and" subjects action_body)*
+//   condition_sequence := subjects condition_body ("and" subjects condition_body)*
+// After a condition, "and" followed by subjects and an action keyword begins the next action sequence
+bool parseSentence(struct Lexer *lexer, struct Sentence *sentence){
+    struct Action *action = initializeAction();
+    if (!parseSubjects(lexer, action)){
+        return false;
+    }
+    while (true){ // Each loop begins with an action whose subjects are already parsed
+        bool conditional = false;
+        if (!parseActionSequence(lexer, sentence, action, &conditional)){
+            return false;
+        }
+        if (!conditional){ // the sentence ended with an action sequence
+            return true;
+        }
+        action = NULL;
+        if (!parseConditionSequence(lexer, sentence, &action)){
+            return false;
+        }
+        if (action == NULL){ // the sentence ended with a condition sequence
+            return true;
+        }
+    }
+}
+
+// Parses actions joined with "and" until the end of the sentence or an "if", the first action already has its subjects
+// The action sequence is added to the sentence and conditional is set if it is followed by conditions
+bool parseActionSequence(struct Lexer *lexer, struct Sentence *sentence, struct Action *action, bool *conditional){
+    struct Action_Sequence *sequence = initializeActionSequence();
+    addActionSequence(sentence, sequence);
+    while (true){
+        if (!parseActionBody(lexer, action)){
+            return false;
+        }
+        sequenceAddAction(sequence, action);
+        struct Token *word = nextToken(lexer); // the word after an action is either "and", "if" or nothing
+        if (word == NULL){ // Terminate
+            return true;
+        }
+        if (word->keyword == KEYWORD_IF){ // Condition
+            *conditional = true;
+            return true;
+        }
+        if (word->keyword != KEYWORD_AND){
+            return false;
+        }
+        action = initializeAction(); // Next action
+        if (!parseSubjects(lexer, action)){
+            return false;
+        }
+    }
+}
+
+// Parses conditions joined with "and" until the end of the sentence or the subjects of the next action
+// If an action follows the conditions it is returned in next_action with its subjects parsed
+bool parseConditionSequence(struct Lexer *lexer, struct Sentence *sentence, struct Action **next_action){
+    struct Condition_Sequence *sequence = initializeConditionSequence();
+    addConditionSequence(sentence, sequence);
+    while (true){
+        // Subjects are parsed into an action first since we do not know yet whether they belong to a condition or the next action
+        struct Action *subjects = initializeAction();
+        if (!parseSubjects(lexer, subjects)){
+            return false;
+        }
+        enum Keyword keyword = peekToken(lexer, 0)->keyword; // parseSubjects makes sure that a keyword follows
+        if (keyword == KEYWORD_GO || keyword == KEYWORD_SELL || keyword == KEYWORD_BUY){
+            // However we have to be careful about "action sequence if action sequence" case
+            if (sequence->condition_count == 0){
+                return false;
+            }
+            *next_action = subjects;
+            return true;
+        }
+        // the subjects belong to a condition so move them
+        struct Condition *condition = initializeCondition();
+        condition->subjects = subjects->subjects;
+        condition->num_of_subjects = subjects->num_of_subjects;
+        condition->subj_array_size = subjects->subj_array_size;
+        if (!parseConditionBody(lexer, condition)){
+            return false;
+        }
+        sequenceAddCondition(sequence, condition);
+        struct Token *word = nextToken(lexer); // the word after a condition is either "and" or nothing
+        if (word == NULL){ // Terminate
+            return true;
+        }
+        if (word->keyword != KEYWORD_AND){
+            return false;
+        }
+    }
+}
+
+// Parses "subject (and subject)*" into the subjects of an action, a keyword has to follow the last subject
+bool parseSubjects(struct Lexer *lexer, struct Action *action){
+    while (true){
+        struct Token *word = nextToken(lexer);
+        if (word == NULL || !checkName(lexer, word)){ // If subject is invalid
+            return false;
+        }
+        actionAddSubject(action, word->text);
+        word = peekToken(lexer, 0); // take the next word after the subject
+        if (word == NULL){ // a sentence can not end with a subject
+            return false;
+        }
+        if (word->keyword != KEYWORD_AND){ // the keyword of the action or condition
+            return true;
+        }
+        nextToken(lexer); // If next word is "and" then there is another subject
+    }
+}
+
+// Parses an action after its subjects: "go to location", "sell items (to trader)?" or "buy items (from trader)?"
+bool parseActionBody(struct Lexer *lexer, struct Action *action){
+    struct Token *word = nextToken(lexer);
+    if (word->keyword == KEYWORD_GO){
+        action->mode = ACTION_GO_TO;
+        word = nextToken(lexer);
+        if (word == NULL || word->keyword != KEYWORD_TO){
+            return false;
+        }
+        word = nextToken(lexer); // This will be the location
+        if (word == NULL || !checkName(lexer, word)){
+            return false;
+        }
+        actionAddObject(action, word->text, 1); // Add the location
+        return true;
+    }
+    enum Keyword trader_keyword; // the keyword before the trader, "to" for sell and "from" for buy
+    if (word->keyword == KEYWORD_SELL){
+        action->mode = ACTION_SELL;
+        trader_keyword = KEYWORD_TO;
+    }
+    else if (word->keyword == KEYWORD_BUY){
+        action->mode = ACTION_BUY;
+        trader_keyword = KEYWORD_FROM;
+    }
+    else{
+        return false;
+    }
+    if (!parseItems(lexer, action, NULL)){
+        return false;
+    }
+    word = peekToken(lexer, 0);
+    if (word == NULL || word->keyword != trader_keyword){
+        return true;
+    }
+    nextToken(lexer);
+    action->mode = trader_keyword == KEYWORD_TO ? ACTION_SELL_TO : ACTION_BUY_FROM;
+    word = nextToken(lexer); // current word is trader
+    if (word == NULL || !checkName(lexer, word)){ // check if trader is valid
+        return false;
+    }
+    int trader = internString(word->text);
+    for (int i = 0; i < action->num_of_subjects; ++i) {
+        if (trader == action->subjects[i]){ // trader can not be a subject
+            return false;
+        }
+    }
+    action->trader = trader;
+    return true;
+}
+
+// Parses a condition after its subjects: "at location" or "has ((more|less) than)? items"
+bool parseConditionBody(struct Lexer *lexer, struct Condition *condition){
+    struct Token *word = nextToken(lexer);
+    if (word->keyword == KEYWORD_AT){
+        // Format will be "subject(s) at location"
+        condition->mode = CONDITION_AT;
+        word = nextToken(lexer); // read the next word which is location
+        if (word == NULL || !checkName(lexer, word)){
+            return false;
+        }
+        conditionAddObject(condition, word->text, 1); // add location to condition
+        return true;
+    }
+    if (word->keyword != KEYWORD_HAS){
+        return false;
+    }
+    // If the next word is "has" then there are 3 possibilities:
+    // has, has more than, has less than
+    condition->mode = CONDITION_HAS;
+    word = peekToken(lexer, 0);
+    if (word != NULL && (word->keyword == KEYWORD_MORE || word->keyword == KEYWORD_LESS)){
+        condition->mode = word->keyword == KEYWORD_MORE ? CONDITION_HAS_MORE : CONDITION_HAS_LESS;
+        nextToken(lexer);
+        word = nextToken(lexer);
+        if (word == NULL || word->keyword != KEYWORD_THAN){ // after "more" or "less" there should be "than"
+            return false;
+        }
+    }
+    return parseItems(lexer, NULL, condition);
+}
+
+// Parses "amount item (and amount item)*" into the objects of either an action or a condition
+// An "and" that is not followed by an amount is not read since it begins the next action or condition
+bool parseItems(struct Lexer *lexer, struct Action *action, struct Condition *condition){
+    while (true){
+        int amount = parseAmount(lexer, nextToken(lexer)); // -1 if the number is invalid
+        if (amount == -1){
+            return false;
+        }
+        struct Token *word = nextToken(lexer); // this is item
+        if (word == NULL || !checkName(lexer, word)){ // check whether item is valid or not
+            return false;
+        }
+        if (action != NULL){
+            actionAddObject(action, word->text, amount);
+        }
+        else{
+            conditionAddObject(condition, word->text, amount);
+        }
+        word = peekToken(lexer, 0);
+        if (word == NULL || word->keyword != KEYWORD_AND || !startsItem(lexer, 1)){
+            return true;
+        }
+        nextToken(lexer); // skip "and", the next word is the amount of another item
+    }
+}
+
+// There should not be any duplicate items or subjects for each action and condition
+bool sentenceHasDuplicates(struct Sentence *sentence){
+    for (int i = 0; i < sentence->condition_sequence_count; ++i) { // For each condition sequence
+        struct Condition_Sequence *seq = sentence->condition_sequences[i];
+        for (int j = 0; j < seq->condition_count; ++j) { // For each condition
+            struct Condition *cond = seq->conditions[j];
+            if (hasDuplicates(cond->subjects,cond->num_of_subjects) || hasDuplicates(cond->objects,cond->num_of_objects)){
+                return true;
+            }
+        }
+    }
+    for (int i = 0; i < sentence->action_sequence_count; ++i) { // For each action sequence
+        struct Action_Sequence *seq = sentence->action_sequences[i];
+        for (int j = 0; j < seq->action_count; ++j) { // For each action
+            struct Action *act = seq->actions[j];
+            if (hasDuplicates(act->subjects,act->num_of_subjects) || hasDuplicates(act->objects,act->num_of_objects)){
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Lowers a parsed sentence into an immutable plan in one memory block, a NULL sentence gives an INVALID plan
+// The text of the plan is built from the tokens of the lexer
+// For the template of a prepared statement the places of its parameters are recorded in prepared instead of being resolved
+struct Plan *compilePlan(struct Sentence *sentence, struct Lexer *lexer, struct Person_Registry *registry, struct Prepared *prepared){
+    // count everything first so that the plan can be allocated at once
+    size_t text_length = 0;
+    for (int i = 0; i < lexer->token_count; ++i) {
+        text_length += lexer->tokens[i].length + 1; // a space or the terminating '\0' after every token
+    }
+    int sequence_count = 0;
+    int action_count = 0;
+    int condition_count = 0;
+    int id_count = 0; // subjects and objects of every action and condition
+    if (sentence != NULL){
+        sequence_count = sentence->action_sequence_count;
+        for (int i = 0; i < sentence->action_sequence_count; ++i) {
+            struct Action_Sequence *seq = sentence->action_sequences[i];
+            action_count += seq->action_count;
+            for (int j = 0; j < seq->action_count; ++j) {
+                id_count += seq->actions[j]->num_of_subjects + 2 * seq->actions[j]->num_of_objects;
+            }
+        }
+        for (int i = 0; i < sentence->condition_sequence_count; ++i) {
+            struct Condition_Sequence *seq = sentence->condition_sequences[i];
+            condition_count += seq->condition_count;
+            for (int j = 0; j < seq->condition_count; ++j) {
+                id_count += seq->conditions[j]->num_of_subjects + 2 * seq->conditions[j]->num_of_objects;
+            }
+        }
+    }
+    char *memory = calloc(1, sizeof(struct Plan) + sequence_count * sizeof(struct Plan_Sequence) + action_count * sizeof(struct Plan_Action)
+            + condition_count * sizeof(struct Plan_Condition) + id_count * sizeof(int) + text_length);
+    struct Plan *plan = (struct Plan *) memory;
+    struct Plan_Sequence *sequences = (struct Plan_Sequence *) (plan + 1);
+    struct Plan_Action *actions = (struct Plan_Action *) (sequences + sequence_count);
+    struct Plan_Condition *conditions = (struct Plan_Condition *) (actions + action_count);
+    int *ids = (int *) (conditions + condition_count);
+    plan->text = (char *) (ids + id_count);
+
+    char *chr = plan->text;
+    for (int i = 0; i < lexer->token_count; ++i) {
+        memcpy(chr, lexer->tokens[i].text, lexer->tokens[i].length);
+        chr += lexer->tokens[i].length;
+        *chr++ = ' ';
+    }
+    chr[-1] = '\0';
+    plan->hash = hashString(plan->text);
+    plan->invalid = sentence == NULL;
+    plan->sequences = sequences;
+    plan->sequence_count = sequence_count;
+    plan->undo_size = 0;
+
+    for (int i = 0; i < sequence_count; ++i) {
+        struct Plan_Sequence *sequence = &sequences[i];
+        struct Action_Sequence *action_sequence = sentence->action_sequences[i];
+        sequence->actions = actions;
+        sequence->action_count = action_sequence->action_count;
+        for (int j = 0; j < action_sequence->action_count; ++j) {
+            struct Action *action = action_sequence->actions[j];
+            struct Plan_Action *plan_action = actions++;
+            plan_action->mode = action->mode;
+            plan_action->num_of_subjects = action->num_of_subjects;
+            plan_action->num_of_objects = action->num_of_objects;
+            plan_action->subjects = ids;
+            for (int k = 0; k < action->num_of_subjects; ++k, ++ids) {
+                if (!addParameterSite(prepared, ids, SITE_PERSON, action->subjects[k])){
+                    *ids = resolvePerson(registry, action->subjects[k]);
+                }
+            }
+            plan_action->objects = ids;
+            memcpy(ids, action->objects, action->num_of_objects * sizeof(int));
+            ids += action->num_of_objects;
+            plan_action->amounts = ids;
+            memcpy(ids, action->amounts, action->num_of_objects * sizeof(int));
+            ids += action->num_of_objects;
+            for (int k = 0; k < action->num_of_objects; ++k) {
+                addParameterSite(prepared, &plan_action->objects[k], SITE_SYMBOL, action->objects[k]);
+                if (action->amounts[k] < -1){ // the amount is a parameter, see parseAmount
+                    addParameterSite(prepared, &plan_action->amounts[k], SITE_AMOUNT, -2 - action->amounts[k]);
+                }
+            }
+            plan_action->trader = -1;
+            if (action->trader != -1 && !addParameterSite(prepared, &plan_action->trader, SITE_PERSON, action->trader)){
+                plan_action->trader = resolvePerson(registry, action->trader);
+            }
+            // at most a new item and an amount for every subject and object and for the trader, or a move of every subject
+            plan->undo_size += 2 * (action->num_of_subjects + 1) * action->num_of_objects + action->num_of_subjects;
+        }
+        sequence->conditions = conditions;
+        sequence->condition_count = 0;
+        if (i == sentence->condition_sequence_count){ // the last action sequence does not have conditions
+            continue;
+        }
+        struct Condition_Sequence *condition_sequence = sentence->condition_sequences[i];
+        sequence->condition_count = condition_sequence->condition_count;
+        for (int j = 0; j < condition_sequence->condition_count; ++j) {
+            struct Condition *condition = condition_sequence->conditions[j];
+            struct Plan_Condition *plan_condition = conditions++;
+            plan_condition->mode = condition->mode;
+            plan_condition->num_of_subjects = condition->num_of_subjects;
+            plan_condition->num_of_objects = condition->num_of_objects;
+            plan_condition->subjects = ids;
+            for (int k = 0; k < condition->num_of_subjects; ++k, ++ids) {
+                if (!addParameterSite(prepared, ids, SITE_PERSON, condition->subjects[k])){
+                    *ids = resolvePerson(registry, condition->subjects[k]);
+                }
+            }
+            plan_condition->objects = ids;
+            memcpy(ids, condition->objects, condition->num_of_objects * sizeof(int));
+            ids += condition->num_of_objects;
+            plan_condition->amounts = ids;
+            memcpy(ids, condition->amounts, condition->num_of_objects * sizeof(int));
+            ids += condition->num_of_objects;
+            for (int k = 0; k < condition->num_of_objects; ++k) {
+                addParameterSite(prepared, &plan_condition->objects[k], SITE_SYMBOL, condition->objects[k]);
+                if (condition->amounts[k] < -1){
+                    addParameterSite(prepared, &plan_condition->amounts[k], SITE_AMOUNT, -2 - condition->amounts[k]);
+                }
+            }
+        }
+    }
+    if (prepared == NULL){ // a template reserves its rows on every execution, when its parameters are bound
+        reservePlanRows(registry, plan);
+    }
+    return plan;
+}
+
+// returns the hashString of the normalized statement (tokens separated by single spaces) without modifying the line
+// It also tells whether the line is a question and how many tokens it has, the same way tokenizeLine does
+unsigned int hashStatement(char *line, bool *question, int *token_count){
+    unsigned int hash = 2166136261u;
+    char *chr = line;
+    while (*chr != '\0'){
+        if (*chr == ' '){ // skip the spaces between tokens
+            chr++;
+            continue;
+        }
+        if (*token_count > 0){ // a single space between tokens
+            hash ^= (unsigned char) ' ';
+            hash *= 16777619u;
+        }
+        while (*chr != '\0' && *chr != ' '){
+            if (*chr == '?'){
+                *question = true;
+            }
+            hash ^= (unsigned char) *chr;
+            hash *= 16777619u;
+            chr++;
+        }
+        (*token_count)++;
+    }
+    return hash;
+}
+
+// returns true if the line has the same tokens as the normalized text of a plan
+bool sameStatement(char *line, char *text){
+    while (*line == ' '){
+        line++;
+    }
+    while (*text != '\0'){
+        if (*text == ' '){ // any number of spaces in the line
+            if (*line != ' '){
+                return false;
+            }
+            while (*line == ' '){
+                line++;
+            }
+            text++;
+            continue;
+        }
+        if (*line != *text){
+            return false;
+        }
+        line++;
+        text++;
+    }
+    while (*line == ' '){
+        line++;
+    }
+    return *line == '\0';
+}
+
+// Constructor of the plan cache
+struct Plan_Cache *initializePlanCache(int capacity){
+    struct Plan_Cache *cache = calloc(1, sizeof(struct Plan_Cache));
+    cache->capacity = capacity;
+    cache->plan_count = 0;
+    cache->bucket_count = INITIAL_SLOT_COUNT;
+    cache->buckets = calloc(cache->bucket_count, sizeof(struct Plan*));
+    cache->newest = NULL;
+    cache->oldest = NULL;
+    return cache;
+}
+
+// returns the cached plan of a line or NULL, a plan that is found becomes the most recently used one
+struct Plan *lookupPlan(struct Plan_Cache *cache, char *line, unsigned int hash){
+    struct Plan *plan = cache->buckets[hash & (cache->bucket_count - 1)];
+    while (plan != NULL && (plan->hash != hash || !sameStatement(line, plan->text))){
+        plan = plan->next_in_bucket;
+    }
+    if (plan == NULL || plan == cache->newest){
+        return plan;
+    }
+    // move the plan to the front of the recently used list
+    plan->newer->older = plan->older;
+    if (plan->older != NULL){
+        plan->older->newer = plan->newer;
+    }
+    else{
+        cache->oldest = plan->newer;
+    }
+    plan->older = cache->newest;
+    plan->newer = NULL;
+    cache->newest->newer = plan;
+    cache->newest = plan;
+    return plan;
+}
+
+// Adds a plan to the cache as the most recently used one, the least recently used plan is freed if the cache is full
+void insertPlan(struct Plan_Cache *cache, struct Plan *plan){
+    if (cache->plan_count == cache->capacity){
+        struct Plan *oldest = cache->oldest;
+        unlinkPlan(cache, oldest);
+        free(oldest);
+    }
+    // Keep the load factor of the hash table at most one
+    if (cache->plan_count + 1 > cache->bucket_count){
+        growPlanBuckets(cache);
+    }
+    struct Plan **bucket = &cache->buckets[plan->hash & (cache->bucket_count - 1)];
+    plan->next_in_bucket = *bucket;
+    *bucket = plan;
+    plan->newer = NULL;
+    plan->older = cache->newest;
+    if (cache->newest != NULL){
+        cache->newest->newer = plan;
+    }
+    else{
+        cache->oldest = plan;
+    }
+    cache->newest = plan;
+    cache->plan_count++;
+}
+
+// Removes a plan from the hash table and the recently used list without freeing it
+void unlinkPlan(struct Plan_Cache *cache, struct Plan *plan){
+    struct Plan **link = &cache->buckets[plan->hash & (cache->bucket_count - 1)];
+    while (*link != plan){
+        link = &(*link)->next_in_bucket;
+    }
+    *link = plan->next_in_bucket;
+    if (plan->newer != NULL){
+        plan->newer->older = plan->older;
+    }
+    else{
+        cache->newest = plan->older;
+    }
+    if (plan->older != NULL){
+        plan->older->newer = plan->newer;
+    }
+    else{
+        cache->oldest = plan->newer;
+    }
+    cache->plan_count--;
+}
+
+// Doubles the number of buckets and rehashes every plan
+void growPlanBuckets(struct Plan_Cache *cache){
+    int bucket_count = cache->bucket_count * 2;
+    struct Plan **buckets = calloc(bucket_count, sizeof(struct Plan*));
+    for (int i = 0; i < cache->bucket_count; i++) {
+        struct Plan *plan = cache->buckets[i];
+        while (plan != NULL){
+            struct Plan *next = plan->next_in_bucket;
+            plan->next_in_bucket = buckets[plan->hash & (bucket_count - 1)];
+            buckets[plan->hash & (bucket_count - 1)] = plan;
+            plan = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_count = bucket_count;
+}
+
+// Constructor of the table of prepared statements
+struct Prepared_Table *initializePreparedTable(){
+    struct Prepared_Table *table = calloc(1, sizeof(struct Prepared_Table));
+    table->statement_count = 0;
+    table->array_size = INITIAL_ARRAY_SIZE;
+    table->statements = calloc(table->array_size, sizeof(struct Prepared*));
+    table->slot_count = INITIAL_SLOT_COUNT;
+    table->slots = allocateSlots(table->slot_count);
+    return table;
+}
+
+// returns the index of the prepared statement with the given name or -1 if there is no such statement
+int findPrepared(struct Prepared_Table *table, int name){
+    unsigned int mask = table->slot_count - 1;
+    for (unsigned int slot = hashId(name) & mask; table->slots[slot] != -1; slot = (slot + 1) & mask) {
+        if (table->statements[table->slots[slot]]->name == name) {
+            return table->slots[slot];
+        }
+    }
+    return -1;
+}
+
+// Registers "prepare name = template", the template is a sentence in which names, items, locations and amounts may be "$parameter"s
+// The template is parsed, checked for duplicates and compiled here once, a statement with the same name is replaced
+// e.g. prepare trade = $who buy $n bread from $seller if $seller has more than $n bread
+// returns true if the statement is registered
+bool prepareStatement(struct Person_Registry *registry, struct Lexer *lexer){
+    struct Prepared *prepared = calloc(1, sizeof(struct Prepared));
+    prepared->name = internString(lexer->tokens[1].text);
+    prepared->parameter_count = 0;
+    prepared->parameter_array_size = INITIAL_ARRAY_SIZE;
+    prepared->parameters = calloc(prepared->parameter_array_size, sizeof(int));
+    prepared->amount_parameters = calloc(prepared->parameter_array_size, sizeof(bool));
+    prepared->site_count = 0;
+    prepared->site_array_size = INITIAL_ARRAY_SIZE;
+    prepared->sites = calloc(prepared->site_array_size, sizeof(struct Parameter_Site));
+    // Parameters are numbered in the order they first appear, execute takes their values in this order
+    for (int i = 3; i < lexer->token_count; ++i) {
+        if (lexer->tokens[i].keyword != KEYWORD_PARAMETER){
+            continue;
+        }
+        int symbol = internString(lexer->tokens[i].text);
+        int parameter = 0;
+        while (parameter < prepared->parameter_count && prepared->parameters[parameter] != symbol){
+            parameter++;
+        }
+        if (parameter < prepared->parameter_count){
+            continue;
+        }
+        if (prepared->parameter_count == prepared->parameter_array_size){ // If array is full reallocate it
+            prepared->parameter_array_size *= 2;
+            prepared->parameters = realloc(prepared->parameters, prepared->parameter_array_size * sizeof(int));
+            prepared->amount_parameters = realloc(prepared->amount_parameters, prepared->parameter_array_size * sizeof(bool));
+        }
+        prepared->parameters[prepared->parameter_count] = symbol;
+        prepared->amount_parameters[prepared->parameter_count] = false;
+        prepared->parameter_count++;
+    }
+
+    // The template begins after "prepare name ="
+    lexer->position = 3;
+    lexer->parameters = true;
+    struct Sentence *sentence = initializeSentence();
+    bool invalid = !parseSentence(lexer, sentence) || sentenceHasDuplicates(sentence);
+    lexer->parameters = false;
+    if (!invalid){
+        prepared->plan = compilePlan(sentence, lexer, registry, prepared);
+        // A parameter can not be both an amount and a name
+        char *uses = arenaAlloc(prepared->parameter_count); // 1 for a name, 2 for an amount
+        for (int i = 0; i < prepared->site_count; ++i) {
+            uses[prepared->sites[i].parameter] |= prepared->sites[i].kind == SITE_AMOUNT ? 2 : 1;
+        }
+        for (int i = 0; i < prepared->parameter_count; ++i) {
+            invalid = invalid || uses[i] == 3;
+            prepared->amount_parameters[i] = uses[i] == 2;
+        }
+    }
+    if (invalid){
+        freePrepared(prepared);
+        writeString("INVALID");
+        endResponse();
+        return false;
+    }
 
+    struct Prepared_Table *table = prepared_table;
+    int index = findPrepared(table, prepared->name);
+    if (index != -1){
+        freePrepared(table->statements[index]);
+        table->statements[index] = prepared;
+    }
+    else{
+        // Keep the load factor of the hash table at most one half
+        if ((table->statement_count + 1) * 2 > table->slot_count){
+            free(table->slots);
+            table->slot_count *= 2;
+            table->slots = allocateSlots(table->slot_count);
+            for (int i = 0; i < table->statement_count; ++i) {
+                insertSlot(table->slots, table->slot_count, hashId(table->statements[i]->name), i);
+            }
+        }
+        if (table->statement_count == table->array_size){ // If array is full reallocate it
+            table->array_size *= 2;
+            table->statements = realloc(table->statements, table->array_size * sizeof(struct Prepared*));
+        }
+        table->statements[table->statement_count] = prepared;
+        insertSlot(table->slots, table->slot_count, hashId(prepared->name), table->statement_count);
+        table->statement_count++;
+    }
+    writeString("OK");
+    endResponse();
+    return true;
+}
 
+// Runs "execute name value...", the values of the parameters are bound into the plan of the prepared statement and it is executed
+// Only the values are checked here: their format, their count and duplicates that they make in an action or a condition
+// returns true if the statement is executed
+bool executePrepared(struct Person_Registry *registry, struct Lexer *lexer){
+    int name = lookupSymbol(lexer->tokens[1].text);
+    int index = name == -1 ? -1 : findPrepared(prepared_table, name);
+    struct Prepared *prepared = index == -1 ? NULL : prepared_table->statements[index];
+    if (prepared == NULL || lexer->token_count - 2 != prepared->parameter_count){
+        writeString("INVALID");
+        endResponse();
+        return false;
+    }
+    // symbol ids of names or amounts in the order of the parameters
+    int *values = arenaAlloc(prepared->parameter_count * sizeof(int));
+    for (int i = 0; i < prepared->parameter_count; ++i) {
+        struct Token *value = &lexer->tokens[i + 2];
+        values[i] = prepared->amount_parameters[i] ? getNum(value) : checkFormat(value) ? internString(value->text) : -1;
+        if (values[i] == -1){
+            writeString("INVALID");
+            endResponse();
+            return false;
+        }
+    }
+    for (int i = 0; i < prepared->site_count; ++i) {
+        struct Parameter_Site *site = &prepared->sites[i];
+        int value = values[site->parameter];
+        *site->target = site->kind == SITE_PERSON ? resolvePerson(registry, value) : value;
+    }
+    if (planHasDuplicates(prepared->plan, registry)){
+        writeString("INVALID");
+        endResponse();
+        return false;
+    }
+    reservePlanRows(registry, prepared->plan);
+    executePlan(prepared->plan, registry);
+    writeString("OK");
+    endResponse();
+    return true;
+}
 
+// returns true if symbol is a "$parameter" of the template that is compiled into prepared and records where its value goes
+// It returns false for every symbol of a sentence that is not a template (prepared is NULL)
+bool addParameterSite(struct Prepared *prepared, int *target, enum Site_Kind kind, int symbol){
+    if (prepared == NULL || symbolName(symbol)[0] != '$'){
+        return false;
+    }
+    int parameter = 0;
+    while (prepared->parameters[parameter] != symbol){ // every parameter is numbered before the template is compiled
+        parameter++;
+    }
+    if (prepared->site_count == prepared->site_array_size){ // If array is full reallocate it
+        prepared->site_array_size *= 2;
+        prepared->sites = realloc(prepared->sites, prepared->site_array_size * sizeof(struct Parameter_Site));
+    }
+    struct Parameter_Site *site = &prepared->sites[prepared->site_count++];
+    site->target = target;
+    site->parameter = parameter;
+    site->kind = kind;
+    return true;
+}
 
-bool checkConditionSequence(struct Condition_Sequence *sequence, struct Person ***people, int *people_count, int *people_array_size);
-bool primitiveCondition(struct Person *person, char *mode, char* object, int count);
+// The duplicate checks of sentenceHasDuplicates and parseActionBody on a plan whose parameters are bound
+// Subjects are compared by their names since hasDuplicates marks symbol ids
+bool planHasDuplicates(struct Plan *plan, struct Person_Registry *registry){
+    for (int i = 0; i < plan->sequence_count; ++i) {
+        struct Plan_Sequence *sequence = &plan->sequences[i];
+        for (int j = 0; j < sequence->action_count; ++j) {
+            struct Plan_Action *action = &sequence->actions[j];
+            int *names = arenaAlloc(action->num_of_subjects * sizeof(int));
+            for (int k = 0; k < action->num_of_subjects; ++k) {
+                names[k] = registry->names[action->subjects[k]];
+                if (action->subjects[k] == action->trader){ // trader can not be a subject
+                    return true;
+                }
+            }
+            if (hasDuplicates(names, action->num_of_subjects) || hasDuplicates(action->objects, action->num_of_objects)){
+                return true;
+            }
+        }
+        for (int j = 0; j < sequence->condition_count; ++j) {
+            struct Plan_Condition *condition = &sequence->conditions[j];
+            int *names = arenaAlloc(condition->num_of_subjects * sizeof(int));
+            for (int k = 0; k < condition->num_of_subjects; ++k) {
+                names[k] = registry->names[condition->subjects[k]];
+            }
+            if (hasDuplicates(names, condition->num_of_subjects) || hasDuplicates(condition->objects, condition->num_of_objects)){
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-void processActionSequence(struct Action_Sequence sequence, struct Person ***people, int *people_count, int *people_array_size);
-void processAction(struct Action action, struct Person ***people, int *people_count, int *people_array_size);
-void primitiveAction(struct Person *person, char *mode, int num, char *object);
+// return true if there is a duplicate in an array of interned ids
+// Each call uses a new stamp and marks the ids it sees in the stamps of the symbol table, so it is linear in size
+bool hasDuplicates(int *idArray, int size) {
+    if (symbol_table->stamp == INT_MAX){ // stamps are about to wrap around so every mark is cleared
+        memset(symbol_table->stamps, 0, sizeof(int) * symbol_table->array_size);
+        symbol_table->stamp = 0;
+    }
+    int stamp = ++symbol_table->stamp;
+    for (int i = 0; i < size; i++) {
+        if (symbol_table->stamps[idArray[i]] == stamp) {
+            return true; // Found a duplicate
+        }
+        symbol_table->stamps[idArray[i]] = stamp;
+    }
+    return false; // No duplicates found
+}
 
+//will return natural number equivalent of a token (invalid case returns -1)
+int getNum(struct Token *token) {
+    if (token == NULL) // Check if the token is NULL
+        return -1;
 
+    for (int i = 0; i < token->length; i++) {
+        if (!isdigit(token->text[i])) {
+            return -1; // If any character is not a digit, return -1
+        }
+    }
 
-void createPerson(struct Person ***people, char *name, int *people_count, int *array_size);
-void addItem(struct Person *person, char *item_name, int amount);
-void who_at(struct Person **people, char *location, int people_count);
-int getItemNumber(struct Person *person, char *item_name);
-int getItemIndex(struct Person *person, char *item_name);
+    // The token is terminated in place so it can be converted directly
+    int num = atoi(token->text);
 
-int getNum(char *word);
-struct Action *initializeAction();
-struct Condition *initializeCondition();
-void actionAddSubject(struct Action *action, char *subject);
-void conditionAddSubject(struct Condition *condition, char *subject);
-void actionAddObject(struct Action *action, char *object, int amount);
-void conditionAddObject(struct Condition *condition, char *object, int amount);
-struct Action_Sequence *initializeActionSequence();
-struct Condition_Sequence *initializeConditionSequence();
-void sequenceAddAction(struct Action_Sequence *sequence, struct Action action);
-void sequenceAddCondition(struct Condition_Sequence *sequence, struct Condition condition);
-void addActionSequence(struct Action_Sequence ***array, struct Action_Sequence *sequence, int *array_size, int *num_elements);
-void addConditionSequence(struct Condition_Sequence ***array, struct Condition_Sequence *sequence, int *array_size, int *num_elements);
-bool checkFormat(char *word);
-
-void freePerson(struct Person *person);
-void freeAction(struct Action *action);
-void freeCondition(struct Condition *condition);
-void freeActionSequence(struct Action_Sequence *sequence);
-void freeConditionSequence(struct Condition_Sequence *sequence);
-
-
-int main(){
-    char input[1025];
-    int people_count = 0; // The total number of Person instances that we stored
-    int people_array_size = INITIAL_ARRAY_SIZE; // Size of the array Person instances are stored in
-    // Allocate the array that we will store our location and items data
-    struct Person **people = calloc(people_array_size, sizeof (struct Person*));
-    while(1){
-        // Take input
-        printf("%s",">> ");
-        fflush(stdout);
-        fgets(input,1025,stdin);
-
-        // "/n" as an input is invalid
-        if (strcmp(strtok(strdup(input), " "), "\n") == 0){
-            printf("INVALID\n");
-            fflush(stdout);
+    if (num >= 0)
+        return num;
+    else
+        return -1;
+}
+
+// checks whether a token is valid or not as a subject, object or location
+bool checkFormat(struct Token *token){
+    // Since null case handled separately we returned true here
+    if (token == NULL){
+        return true;
+    }
+        // Subjects and objects can not be one of keywords
+    else if (token->keyword != NOT_KEYWORD){
+        return false;
+    }
+    // They should consist of uppercase and lowercase letters
+    for (int i = 0; i < token->length; ++i) {
+        char chr = token->text[i];
+        if (!(chr > 64 && chr < 91) && chr != 95 && !(chr > 96 && chr < 123)){
+            return false;
+        }
+    }
+    return true;
+}
+
+// checks whether a token is valid as a subject, object or location, a "$parameter" is valid only while a template is parsed
+bool checkName(struct Lexer *lexer, struct Token *token){
+    return checkFormat(token) || (lexer->parameters && token->keyword == KEYWORD_PARAMETER);
+}
+
+// returns the amount of a token (invalid case returns -1)
+// While a template is parsed a "$parameter" is an amount too, it is stored as -2 - its symbol id until it is bound
+int parseAmount(struct Lexer *lexer, struct Token *token){
+    if (token != NULL && lexer->parameters && token->keyword == KEYWORD_PARAMETER){
+        return -2 - internString(token->text);
+    }
+    return getNum(token);
+}
+
+// returns true if the token at offset is the amount of an "amount item" pair
+// A "$parameter" can also be a subject so it is an amount only if an item follows it instead of a keyword
+bool startsItem(struct Lexer *lexer, int offset){
+    struct Token *token = peekToken(lexer, offset);
+    if (token != NULL && lexer->parameters && token->keyword == KEYWORD_PARAMETER){
+        struct Token *item = peekToken(lexer, offset + 1);
+        return item != NULL && (item->keyword == NOT_KEYWORD || item->keyword == KEYWORD_PARAMETER);
+    }
+    return getNum(token) != -1;
+}
+
+// checks whether a token that begins with '$' is a parameter: "$" followed by at least one letter or underscore
+bool checkParameter(struct Token *token){
+    if (token->length < 2){
+        return false;
+    }
+    for (int i = 1; i < token->length; ++i) {
+        char chr = token->text[i];
+        if (!(chr > 64 && chr < 91) && chr != 95 && !(chr > 96 && chr < 123)){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Keywords placed by their perfect hash, see getKeyword
+static const struct {
+    char *text;
+    enum Keyword keyword;
+} keyword_table[64] = {
+    [8] = {"more", KEYWORD_MORE},
+    [12] = {"NOWHERE", KEYWORD_NOWHERE},
+    [13] = {"if", KEYWORD_IF},
+    [19] = {"where", KEYWORD_WHERE},
+    [24] = {"buy", KEYWORD_BUY},
+    [25] = {"from", KEYWORD_FROM},
+    [27] = {"sell", KEYWORD_SELL},
+    [28] = {"has", KEYWORD_HAS},
+    [29] = {"total", KEYWORD_TOTAL},
+    [31] = {"at", KEYWORD_AT},
+    [33] = {"less", KEYWORD_LESS},
+    [34] = {"NOTHING", KEYWORD_NOTHING},
+    [37] = {"exit", KEYWORD_EXIT},
+    [39] = {"NOBODY", KEYWORD_NOBODY},
+    [46] = {"go", KEYWORD_GO},
+    [48] = {"and", KEYWORD_AND},
+    [50] = {"than", KEYWORD_THAN},
+    [53] = {"?", KEYWORD_QUESTION_MARK},
+    [59] = {"to", KEYWORD_TO},
+    [63] = {"who", KEYWORD_WHO},
+};
+
+// returns the keyword code of a token, every keyword has a different (length + first + 11 * last) % 64
+enum Keyword getKeyword(char *text, int length){
+    int hash = (length + (unsigned char) text[0] + 11 * (unsigned char) text[length - 1]) & 63;
+    char *keyword = keyword_table[hash].text;
+    if (keyword != NULL && strncmp(keyword, text, length) == 0 && keyword[length] == '\0'){
+        return keyword_table[hash].keyword;
+    }
+    return NOT_KEYWORD;
+}
+
+// Constructor of the lexer
+struct Lexer *initializeLexer(){
+    struct Lexer *lexer = calloc(1, sizeof(struct Lexer));
+    lexer->array_size = INITIAL_ARRAY_SIZE;
+    lexer->tokens = calloc(lexer->array_size, sizeof(struct Token));
+    lexer->token_count = 0;
+    lexer->position = 0;
+    return lexer;
+}
+
+// Splits a line into space separated tokens in a single pass, the line is modified in place like strtok does
+void tokenizeLine(struct Lexer *lexer, char *line){
+    lexer->token_count = 0;
+    lexer->position = 0;
+    lexer->question = false;
+    char *chr = line;
+    while (*chr != '\0'){
+        if (*chr == ' '){ // skip the spaces between tokens
+            chr++;
             continue;
         }
-        // Trimming the new line at the end
-        for (int i = 0; input[i] != '\0'; i++) {
-            if (input[i] == '\n') {
-                input[i] = '\0';
-                break;  // Exit the loop once newline character is found
+        char *start = chr;
+        while (*chr != '\0' && *chr != ' '){
+            if (*chr == '?'){
+                lexer->question = true;
             }
+            chr++;
         }
-        // exit the whole process
-        if (strcmp(strtok(strdup(input), " "), "exit") == 0 && strtok(NULL, " ") == NULL){
-            break;
+        if (lexer->token_count == lexer->array_size){ // If array is full reallocate it
+            lexer->array_size *= 2;
+            lexer->tokens = realloc(lexer->tokens, lexer->array_size * sizeof(struct Token));
         }
-        // Question statements
-        if (strchr(input, '?') != NULL){ // If it has a "?" it is a question
-            bool invalid = false;
-            // we used word variable to represent current word we are processing
-            char *word = strtok(input, " ");
-
-            // If the question is who at the first word should be who
-            if (strcmp(word, "who") == 0){
-                word = strtok(NULL, " "); // take the next word
-                if (strcmp(word, "at") != 0){ // next word should be at
-                    invalid = true;
-                    printf("%s\n", "INVALID");
-                    fflush(stdout);
-                    continue;
-                }
-                // After at there should be a location
-                word = strtok(NULL, " ");
+        struct Token *token = &lexer->tokens[lexer->token_count];
+        token->text = start;
+        token->length = chr - start;
+        token->keyword = getKeyword(start, token->length);
+        if (*start == '$' && checkParameter(token)){
+            token->keyword = KEYWORD_PARAMETER;
+        }
+        lexer->token_count++;
+        if (*chr == ' '){ // terminate the token
+            *chr = '\0';
+            chr++;
+        }
+    }
+}
 
-                if (!checkFormat(word)){ // check whether location is valid or not
-                    invalid = true;
-                    printf("%s\n", "INVALID");
-                    fflush(stdout);
-                    continue;
-                }
-                // If it is valid process it
-                who_at(people, word, people_count);
-            }
-            else{ // The questions beside who at
-                // there may be multiple subjects
-                int subject_count = 0; // The number of subjects
-                int subj_array_size = INITIAL_ARRAY_SIZE; //
-                char **subjects = calloc(subj_array_size, sizeof(char*));
-                // If the first word is not who then it should be a subject
-                if (!checkFormat(word)){ // whether subject is valid or not
-                    invalid = true;
-                    printf("%s\n", "INVALID");
-                    fflush(stdout);
-                    free(subjects); // free the allocated memory
-                    continue;
-                }
+// returns the next token of the line or NULL if every token is read
+struct Token *nextToken(struct Lexer *lexer){
+    if (lexer->position == lexer->token_count){
+        return NULL;
+    }
+    return &lexer->tokens[lexer->position++];
+}
 
-                subjects[0] = strdup(word);// If subject is valid add it to subjects array
-                subject_count++;
-                word = strtok(NULL, " "); // Take the second word
-
-                if (strcmp(word, "and") == 0){ // If there are more than one subjects the question must be in "subjects total item ?" format
-                    while(true){ // Take all the subjects in the while loop
-                        word = strtok(NULL, " "); // next subject
-                        if (!checkFormat(word)){
-                            invalid = true;
-                            break;
-                        }
-                        subjects[subject_count] = strdup(word);
-                        subject_count++;
-                        // if there are not enough space in the array reallocate it
-                        if (subject_count == subj_array_size){
-                            subj_array_size *= 2;
-                            subjects = realloc(subjects, subj_array_size * sizeof(char*));
-                        }
-                        // More than one subject is only seen total object ? question
-                        word = strtok(NULL, " ");
-                        if (strcmp(word, "total") == 0){ // If the word is total
-                            word = strtok(NULL, " "); // next word should be the object
-                            break; // Get out of the while loop for finding subjects
-                        }
-                    }
-                    if(!checkFormat(word)){ // If the object is not valid
-                        invalid = true;
-                    }
-                    if (invalid){
-                        printf("%s\n", "INVALID");
-                        fflush(stdout);
-                        // free the allocated memory
-                        for (int i = 0; i < subject_count; ++i) {
-                            free(subjects[i]);
-                        }
-                        free(subjects);
-                        continue;
-                    }
+// returns a token after the current position without reading it or NULL if there is no such token
+struct Token *peekToken(struct Lexer *lexer, int offset){
+    if (lexer->position + offset >= lexer->token_count){
+        return NULL;
+    }
+    return &lexer->tokens[lexer->position + offset];
+}
 
-                    int total = 0; // the number represents total
-                    for (int i = 0; i < subject_count; ++i) { // For each subject
-                        // find the subject and add its item number to total
-                        total += getItemNumber(findPerson(&people, subjects[i], &people_count, &people_array_size), word);
-                    }
-                    word = strtok(NULL, " "); // "?"
-                    if(strcmp(word, "?") != 0){ // no multiple items
-                        printf("%s\n", "INVALID");
-                        fflush(stdout);
-                        // free the allocated memory
-                        for (int i = 0; i < subject_count; ++i) {
-                            free(subjects[i]);
-                        }
-                        free(subjects);
-                        continue;
-                    }
-                    word = strtok(NULL, " ");
-                    if(word != NULL){ // no word must come after "?"
-                        printf("%s\n", "INVALID");
-                        fflush(stdout);
-                        // free the allocated memory
-                        for (int i = 0; i < subject_count; ++i) {
-                            free(subjects[i]);
-                        }
-                        free(subjects);
-                        continue;
-                    }
-                    printf("%d\n", total); // print out the answer
-                    fflush(stdout);
-                }
-                else if (strcmp(word, "where") == 0){ // If the question is in "subject where ?" format
-                    // first find the person
-                    struct Person *subject = findPerson(&people, subjects[0], &people_count, &people_array_size);
-                    word = strtok(NULL, " "); // "?"
-                    if(strcmp(word, "?") != 0){
-                        printf("%s\n", "INVALID");
-                        fflush(stdout);
-                        // free the allocated memory
-                        for (int i = 0; i < subject_count; ++i) {
-                            free(subjects[i]);
-                        }
-                        free(subjects);
-                        continue;
-                    }
-                    word = strtok(NULL, " ");
-                    if(word != NULL){ // no word must come after "?"
-                        printf("%s\n", "INVALID");
-                        fflush(stdout);
-                        // free the allocated memory
-                        for (int i = 0; i < subject_count; ++i) {
-                            free(subjects[i]);
-                        }
-                        free(subjects);
-                        continue;
-                    }
-                    printf("%s\n", subject->location); // then print its location
-                    fflush(stdout);
-                }
-                    // Multiple subjects already handled so the question must be in "subject total ((optional) item) ?" format
-                else if (strcmp(word, "total") == 0){
-                    struct Person *subject = findPerson(&people, subjects[0], &people_count, &people_array_size);
-                    word = strtok(NULL, " "); // "?"
-                    if(strcmp(word, "?") == 0){ // If there is no next word print out all the inventory of the subject
-                        word = strtok(NULL, " ");
-                        if(word != NULL){ // no word must come after "?"
-                            printf("%s\n", "INVALID");
-                            fflush(stdout);
-                            // free the allocated memory
-                            for (int i = 0; i < subject_count; ++i) {
-                                free(subjects[i]);
-                            }
-                            free(subjects);
-                            continue;
-                        }
-                        int grand_total = 0; // total number of objects in the inventory
-                        for (int i = 0; i < subject->item_count; ++i) { // For each item
-                            int amount = subject->amounts[i]; // amount of a specific item
-                            if (amount == 0){ // If the amount is 0  continue
-                                continue;
-                            }
-                            if (grand_total > 0){ // if grand total is nonzero then print "and" before the item
-                                printf(" and %d ", amount);
-                                printf("%s", subject->items[i]);
-                                fflush(stdout);
-                                grand_total += amount;
-                            }
-                            else{ // if the grant total is 0 then it is the first item
-                                printf("%d ", amount);
-                                printf("%s", subject->items[i]);
-                                fflush(stdout);
-                                grand_total += amount;
-                            }
-                        }
-                        if (grand_total == 0){ // if grand total is 0 then no item in inventory
-                            printf("%s", "NOTHING");
-                            fflush(stdout);
-                        }
-                        printf("%s\n", "");
-                        fflush(stdout);
-                    }
-                    else{   // word is item (subject total item)
-                        if (!checkFormat(word)){ // check whether object is valid or not
-                            invalid = true;
-                            printf("%s\n", "INVALID");
-                            fflush(stdout);
-                            continue;
-                        }
-                        char *object = strdup(word); // take the object
-                        word = strtok(NULL, " ");
-                        if (strcmp(word, "?") != 0){ // "?"
-                            invalid = true;
-                            printf("%s\n", "INVALID");
-                            fflush(stdout);
-                            continue;
-                        }
-                        word = strtok(NULL, " ");
-                        if (word != NULL){ // There should be nothing after "?"
-                            invalid = true;
-                            printf("%s\n", "INVALID");
-                            fflush(stdout);
-                            continue;
-                        }
-                        printf("%d\n", getItemNumber(subject, object));
-                        fflush(stdout);
+// Hashes a string with FNV-1a, used for interning strings
+unsigned int hashString(char *str){
+    unsigned int hash = 2166136261u;
+    while (*str != '\0'){
+        hash ^= (unsigned char) *str;
+        hash *= 16777619u;
+        str++;
+    }
+    return hash;
+}
 
+// Hashes an interned string id, used for indexing the person registry and inventories
+unsigned int hashId(int id){
+    unsigned int hash = (unsigned int) id * 2654435761u; // Knuth's multiplicative hash
+    return hash ^ (hash >> 16);
+}
 
-                    }
+// Constructor of the arena, the first block is allocated up front
+struct Arena *initializeArena(){
+    struct Arena *new_arena = calloc(1, sizeof(struct Arena));
+    new_arena->first = createArenaBlock(ARENA_BLOCK_SIZE);
+    new_arena->current = new_arena->first;
+    arena = new_arena;
+    return new_arena;
+}
 
-                }
-                    // If the word is none of them then it is invalid
-                else{
-                    invalid = true;
-                    printf("%s\n", "INVALID");
-                    fflush(stdout);
-                    // free the allocated memory
-                    free(subjects[0]);
-                    free(subjects);
-                    continue;
-                }
+// allocates an empty arena block with size usable bytes
+struct Arena_Block *createArenaBlock(size_t size){
+    struct Arena_Block *block = malloc(sizeof(struct Arena_Block) + size);
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
 
-                // free the allocated memory
-                for (int i = 0; i < subject_count; ++i) {
-                    free(subjects[i]);
-                }
-                free(subjects);
+// returns zeroed memory that stays valid until the next resetArena
+// When the current block is full the next block is used, a new block is chained only if there is none big enough
+void *arenaAlloc(size_t size){
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+    struct Arena_Block *block = arena->current;
+    while (block->used + size > block->size){
+        if (block->next == NULL){
+            // each new block is at least twice as big as the previous one so a statement needs few blocks
+            size_t new_size = block->size * 2;
+            if (new_size < size){
+                new_size = size;
             }
-
+            block->next = createArenaBlock(new_size);
         }
+        block = block->next;
+        block->used = 0;
+        arena->current = block;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    memset(memory, 0, size);
+    return memory;
+}
 
-            // Action statements
-        else{
-            bool invalid = false;
-            int action_array_size = INITIAL_ARRAY_SIZE; // size of the array that stores action sequences
-            int condition_array_size = INITIAL_ARRAY_SIZE; // size of the array that stores condition sequences
-            int action_sequence_count = 0; // Total number of action sequences
-            int condition_sequence_count = 0; // Total number of condition sequences
-
-            struct Action_Sequence **action_sequence_list; // action_sequence_list is a pointer to an array of action sequences
-            struct Condition_Sequence **condition_sequence_list; // condition_sequence_list is a pointer to an array of condition sequences
-            action_sequence_list = calloc(action_array_size, sizeof(struct Action_Sequence*));
-            condition_sequence_list = calloc(condition_array_size, sizeof(struct Condition_Sequence*));
-
-            char *word;
-            word = strtok(input, " "); // the first word of the sentence which is a subject
-            struct Action *action = initializeAction(); // current instances to store data
-            struct Condition *condition = initializeCondition();
-
-            struct Action_Sequence *action_sequence = initializeActionSequence();
-            struct Condition_Sequence *condition_sequence = initializeConditionSequence();
-            // Each time loop begins with a subject of an action
-            while (!invalid && word != NULL ){
-                if(!checkFormat(word)){ // If subject is invalid
-                    invalid = true;
-                    break;
-                }
-                actionAddSubject(action,word); // If subject is valid add it to the action
-                word = strtok(NULL," "); // take the next word after the subject
-                if(word == NULL){ // if there is no next word then sentence is invalid
-                    invalid = true;
-                    break;
-                }
-                if (strcmp(word,"and") == 0){ // If next word is "and" then there is another subject so continue
-                    word = strtok(NULL," ");
-                    if (word == NULL){
-                        invalid = true;
-                        break;
-                    }
-                    continue;
-                }
+// the arena version of realloc, old memory is not reused until the next reset
+void *arenaGrow(void *memory, size_t old_size, size_t new_size){
+    void *new_memory = arenaAlloc(new_size);
+    memcpy(new_memory, memory, old_size);
+    return new_memory;
+}
 
+// releases every allocation at once, the blocks are kept for the next statement
+void resetArena(){
+    arena->current = arena->first;
+    arena->first->used = 0;
+}
 
-                action_keywords: // at this point we have stored all the subjects of an action and will continue from keywords
+// Constructor of the symbol table, "NOWHERE" is interned first so that its id is NOWHERE_SYMBOL
+struct Symbol_Table *initializeSymbolTable(){
+    struct Symbol_Table *table = calloc(1, sizeof(struct Symbol_Table));
+    table->symbol_count = 0;
+    table->array_size = INITIAL_ARRAY_SIZE;
+    table->strings = calloc(table->array_size, sizeof(char*));
+    table->stamps = calloc(table->array_size, sizeof(int));
+    table->stamp = 0;
+    table->slot_count = INITIAL_SLOT_COUNT;
+    table->slots = allocateSlots(table->slot_count);
+    symbol_table = table;
+    internString("NOWHERE");
+    return table;
+}
 
+// returns the id of a string or -1 if it was never interned
+int lookupSymbol(char *str){
+    // the count is loaded before the table, a table that is replaced meanwhile is probed at most once around
+    int slot_count = ACQUIRE(symbol_table->slot_count);
+    int *slots = ACQUIRE(symbol_table->slots);
+    unsigned int mask = slot_count - 1;
+    // linear probing until we find the string or an empty slot
+    unsigned int slot = hashString(str) & mask;
+    for (int probe = 0; probe < slot_count; ++probe, slot = (slot + 1) & mask) {
+        int id = ACQUIRE(slots[slot]);
+        if (id == -1){
+            return -1;
+        }
+        if (id < ACQUIRE(symbol_table->symbol_count) && strcmp(ACQUIRE(symbol_table->strings)[id], str) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
 
-                if (strcmp(word, "go") == 0){ // If the keyword is "go" we will iterate "subject go to location" operation
-                    action->mode = "go to";
-                    word = strtok(NULL," ");
-                    if (word == NULL){
-                        invalid = true;
-                        break;
-                    }
-                    if (strcmp(word,"to") != 0){ // Read to
-                        invalid = true;
-                        break;
-                    }
-                    word = strtok(NULL," "); // This will be the location
-                    if (word == NULL){
-                        invalid = true;
-                        break;
-                    }
-                    if(!checkFormat(word)){
-                        invalid = true;
-                        break;
-                    }
-                    actionAddObject(action,word,1); // Add the location
-                    word = strtok(NULL," "); // Read the next word which should be either "and" or "if"
-                    if (word == NULL){ // Terminate
-                        sequenceAddAction(action_sequence,*action); // add action to sequence
-                        action = initializeAction();
-                        // add current action sequence to action_sequence_list
-                        addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                        action_sequence = initializeActionSequence();
-                        break;
-                    }
-                    else if (strcmp(word,"and") == 0){ // Next Action
-                        sequenceAddAction(action_sequence,*action); // add action to sequence
-                        action = initializeAction(); // create new action
-                        word = strtok(NULL," "); // read the subject of the new action
-                        if (word == NULL){ // If there is no subject
-                            invalid = true;
-                            break;
-                        }
-                        continue; // each loop will begin when word = subject of an action so continue to loop
-                    }
-                    else if (strcmp(word,"if") == 0){ /// Condition
-                        sequenceAddAction(action_sequence,*action); // add action to sequence
-                        action = initializeAction(); // create a new action
-                        // Add action sequence to action_sequence_list
-                        addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                        action_sequence = initializeActionSequence();
-                        /// Continue with conditional statement
-                        word = strtok(NULL, " ");
-                        if (word == NULL){ // If there is no word after "if" it is invalid
-                            invalid = true;
-                        }
-                        //Each while loop will begin with a subject of a conditional statement
-                        while (word != NULL){ // Current word is the subject of a conditional statement
-                            if(!checkFormat(word)){
-                                invalid = true;
-                                break;
-                            }
-                            conditionAddSubject(condition, word);// If subject is valid add it to condition
-                            word = strtok(NULL," "); // Take the next word which is keyword
-                            if(word == NULL){
-                                invalid = true;
-                                break;
-                            }
-                            // If keyword is "and" then there are more subjects to process so continue from the beginning of the while loop
-                            if (strcmp("and",word) == 0){
-                                word = strtok(NULL," ");
-                                continue;
-                            }
-
-                                // if the keyword is "at" then we will question its location
-                            else if (strcmp("at",word) == 0){
-                                // Format will be "subject(s) at location"
-                                condition->mode = "at";
-                                word = strtok(NULL," "); // read the next word which is location
-                                if(word == NULL){
-                                    invalid = true;
-                                    break;
-                                }
-                                if(!checkFormat(word)){
-                                    invalid = true;
-                                    break;
-                                }
-                                conditionAddObject(condition,word,1); // add location to condition
-                                word = strtok(NULL," ");
-                                if (word == NULL){ // Terminate
-                                    sequenceAddCondition(condition_sequence, *condition); // add condition to sequence
-                                    condition = initializeCondition();
-                                    addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                    condition_sequence = initializeConditionSequence();
-                                    break;
-                                }
-                                else if (strcmp(word,"and") == 0){ //
-                                    sequenceAddCondition(condition_sequence,*condition); // add condition to sequence
-                                    condition = initializeCondition();
-                                    word = strtok(NULL," ");
-                                    if (word == NULL){
-                                        invalid = true;
-                                    }
-                                    continue;
-                                }
-                            }
-
-                                // If the next word is "has" then there are 3 possibilities:
-                                // has, has more than, has less than
-                            else if (strcmp(word,"has") == 0){
-                                condition->mode = "has";
-                                word = strtok(NULL, " "); // read the word after "has"
-                                if(word == NULL){
-                                    invalid = true;
-                                    break;
-                                }
-                                if (strcmp(word, "more") == 0){ // if the word is "more"
-                                    condition->mode = "has more";
-                                    word = strtok(NULL," ");
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    if (strcmp(word,"than") != 0){ // after "more" there should be "than"
-                                        invalid = true;
-                                        break;
-                                    }
-                                    word = strtok(NULL," "); // read the next word which is the amount of object
-                                }
-                                else if (strcmp(word, "less") == 0){ // if the word is "less"
-                                    condition->mode = "has less";
-                                    word = strtok(NULL," ");
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    if (strcmp(word,"than") != 0){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    word = strtok(NULL," ");// read the next word which is the amount of object
-                                }
-
-                                // Our current word is supposed to be the amount of first object
-                                if (word == NULL){
-                                    invalid = true;
-                                }
-                                int amount = getNum(word); // getNum is a method that returns -1 if the number is invalid
-                                if (amount != -1){ // If the number is valid
-                                    while(amount != -1){
-                                        word = strtok(NULL," "); // read the next word which is the item
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if(!checkFormat(word)){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        conditionAddObject(condition,word,amount); // add item as an object
-                                        word = strtok(NULL," "); // read the next word
-                                        if (word == NULL){ // terminate
-                                            sequenceAddCondition(condition_sequence, *condition);
-                                            condition = initializeCondition();
-                                            addConditionSequence(&condition_sequence_list,condition_sequence, &condition_array_size, &condition_sequence_count);
-                                            condition_sequence = initializeConditionSequence();
-                                            break;
-                                        }
-                                            // After the "and" there may be next item or next sentence
-                                            // If the word is a number than "amount != -1" so code will continue to store objects
-                                            // If the word is not a number then loop won't continue to take objects
-                                        else if(strcmp(word,"and") == 0){
-                                            word = strtok(NULL," ");
-                                            if (word == NULL){
-                                                invalid = true;
-                                            }
-                                            amount = getNum(word);
-                                            continue;
-                                        }
-                                    }
-                                    if (word != NULL){ // after taking the last object add condition to the sequence
-                                        sequenceAddCondition(condition_sequence, *condition);
-                                        condition = initializeCondition();
-                                    }
-                                }
-                                else{ // If it is invalid
-                                    invalid = true;
-                                }
-                            }
-
-                                // Since after an "and" we may have an action sentence we have to iterate it
-                                // In that case our current condition subjects are actually action subjects and our current word is an action keyword
-                                // That is why we have to go back action keywords
-                            else if (strcmp(word, "go") == 0 || strcmp(word, "sell") == 0 || strcmp(word, "buy") == 0){
-
-                                // However we have to be careful about "action sequence if action sequence" case
-                                if (condition_sequence->condition_count == 0){
-                                    invalid = true;
-                                    break;
-                                }
-                                // our condition subjects were actually the subjects of the next action
-                                for (int i = 0; i < condition->num_of_subjects; ++i) {
-                                    action->subjects[i] = strdup(condition->subjects[i]);
-                                }
-                                action->num_of_subjects = condition->num_of_subjects;
-                                action->subj_array_size = condition->subj_array_size;
-                                condition = initializeCondition(); // reset the condition
-                                // add condition to the condition sequence
-                                addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                condition_sequence = initializeConditionSequence();
-                                goto action_keywords;
-                            }
-                            else{ // the keyword is invalid
-                                invalid = true;
-                                break;
-                            }
-                        }
+// returns the id of a string, the string is copied into the table the first time it is seen
+int internString(char *str){
+    int id = lookupSymbol(str);
+    if (id != -1){
+        return id;
+    }
+    beginWrite();
+    // Keep the load factor of the hash table at most one half
+    if ((symbol_table->symbol_count + 1) * 2 > symbol_table->slot_count){
+        growSymbolSlots(symbol_table);
+    }
+    id = symbol_table->symbol_count;
+    if (id + 1 == symbol_table->array_size){ // If array is almost full reallocate it
+        symbol_table->array_size *= 2;
+        PUBLISH(symbol_table->strings, growShared(symbol_table->strings, sizeof(char*) * (symbol_table->array_size / 2), sizeof(char*) * (symbol_table->array_size)));
+        symbol_table->stamps = realloc(symbol_table->stamps, sizeof(int) * (symbol_table->array_size));
+    }
+    symbol_table->stamps[id] = 0;
+    symbol_table->strings[id] = strdup(str);
+    PUBLISH(symbol_table->symbol_count, id + 1); // the string is counted after it is copied and indexed after it is counted
+    insertSlot(symbol_table->slots, symbol_table->slot_count, hashString(str), id);
+    endWrite();
+    return id;
+}
 
-                    }
-                    else{
-                        invalid = true;
-                        break;
-                    }
+// returns the string of an interned id
+char *symbolName(int id){
+    if (id < 0 || id >= ACQUIRE(symbol_table->symbol_count)){ // only a reader sees such an id, when the writer changed the world meanwhile
+        torn_read = true;
+        return "";
+    }
+    return ACQUIRE(symbol_table->strings)[id];
+}
 
+// Doubles the hash table of the symbol table and reinserts every id
+// The new table is complete before it replaces the old one so that readers never see a table with missing ids
+void growSymbolSlots(struct Symbol_Table *table){
+    int slot_count = table->slot_count * 2;
+    int *slots = allocateSlots(slot_count);
+    for (int id = 0; id < table->symbol_count; ++id) {
+        insertSlot(slots, slot_count, hashString(table->strings[id]), id);
+    }
+    retireShared(table->slots);
+    PUBLISH(table->slots, slots); // the table is replaced before its count grows, see lookupSymbol
+    PUBLISH(table->slot_count, slot_count);
+}
 
-                }
-                else if (strcmp(word, "sell") == 0){
-                    action->mode = "sell"; // set the mode
-                    word = strtok(NULL," "); // the word is the amount
-                    int amount = getNum(word);
-                    if (amount == -1){ // The amount is invalid
-                        invalid = true;
-                        break;
-                    }
-                    while (getNum(word) != -1){ // while there is a valid amount
-                        word = strtok(NULL," "); // this is item
-                        if (word == NULL){
-                            invalid = true;
-                            break;
-                        }
-                        if(!checkFormat(word)){ // check whether item is valid or not
-                            invalid = true;
-                            break;
-                        }
-                        actionAddObject(action,word,amount); // if item is valid add it as an object
-                        // after adding item we should either terminate, add another item or continue with the next action, add a trader or process the condition
-                        word = strtok(NULL," ");
-                        if (word == NULL){ // Terminate
-                            sequenceAddAction(action_sequence,*action); // add action to sequence
-                            action = initializeAction();
-                            addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                            action_sequence = initializeActionSequence();
-                            break;
-                        }
-                        else if(strcmp(word,"and") == 0){ // If the word is and
-                            word = strtok(NULL," "); // take the next word after "and"
-                            if (word == NULL){
-                                invalid = true;
-                                break;
-                            }
-                            amount = getNum(word);
-                            if (amount == -1){ // if the next word is not a number you have a new action
-                                sequenceAddAction(action_sequence,*action); // add action to sequence
-                                action = initializeAction(); // reset action
-                                break; // don't process amounts anymore
-                            }
-                            continue;
-                        }
-                        else if (strcmp(word,"if") == 0){ /// Condition
-                            sequenceAddAction(action_sequence,*action); // add action to sequence
-                            action = initializeAction(); // create a new action
-                            // Add action sequence to action_sequence_list
-                            addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                            action_sequence = initializeActionSequence();
-                            /// Continue with conditional statement
-                            word = strtok(NULL, " ");
-                            if (word == NULL){ // If there is no word after "if" it is invalid
-                                invalid = true;
-                            }
-                            //Each while loop will begin with a subject of a conditional statement
-                            while (word != NULL){ // Current word is the subject of a conditional statement
-                                if(!checkFormat(word)){
-                                    invalid = true;
-                                    break;
-                                }
-                                conditionAddSubject(condition, word);// If subject is valid add it to condition
-                                word = strtok(NULL," "); // Take the next word which is keyword
-                                if(word == NULL){
-                                    invalid = true;
-                                    break;
-                                }
-                                // If keyword is "and" then there are more subjects to process so continue from the beginning of the while loop
-                                if (strcmp("and",word) == 0){
-                                    word = strtok(NULL," ");
-                                    continue;
-                                }
-
-                                    // if the keyword is "at" then we will question its location
-                                else if (strcmp("at",word) == 0){
-                                    // Format will be "subject(s) at location"
-                                    condition->mode = "at";
-                                    word = strtok(NULL," "); // read the next word which is location
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    if(!checkFormat(word)){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    conditionAddObject(condition,word,1); // add location to condition
-                                    word = strtok(NULL," ");
-                                    if (word == NULL){ // Terminate
-                                        sequenceAddCondition(condition_sequence, *condition); // add condition to sequence
-                                        condition = initializeCondition();
-                                        addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                        condition_sequence = initializeConditionSequence();
-                                        break;
-                                    }
-                                    else if (strcmp(word,"and") == 0){ //
-                                        sequenceAddCondition(condition_sequence,*condition); // add condition to sequence
-                                        condition = initializeCondition();
-                                        word = strtok(NULL," ");
-                                        if (word == NULL){
-                                            invalid = true;
-                                        }
-                                        continue;
-                                    }
-                                }
-
-                                    // If the next word is "has" then there are 3 possibilities:
-                                    // has, has more than, has less than
-                                else if (strcmp(word,"has") == 0){
-                                    condition->mode = "has";
-                                    word = strtok(NULL, " "); // read the word after "has"
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    if (strcmp(word, "more") == 0){ // if the word is "more"
-                                        condition->mode = "has more";
-                                        word = strtok(NULL," ");
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if (strcmp(word,"than") != 0){ // after "more" there should be "than"
-                                            invalid = true;
-                                            break;
-                                        }
-                                        word = strtok(NULL," "); // read the next word which is the amount of object
-                                    }
-                                    else if (strcmp(word, "less") == 0){ // if the word is "less"
-                                        condition->mode = "has less";
-                                        word = strtok(NULL," ");
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if (strcmp(word,"than") != 0){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        word = strtok(NULL," ");// read the next word which is the amount of object
-                                    }
-
-                                    // Our current word is supposed to be the amount of first object
-                                    if (word == NULL){
-                                        invalid = true;
-                                    }
-                                    int amount = getNum(word); // getNum is a method that returns -1 if the number is invalid
-                                    if (amount != -1){ // If the number is valid
-                                        while(amount != -1){
-                                            word = strtok(NULL," "); // read the next word which is the item
-                                            if(word == NULL){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            if(!checkFormat(word)){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            conditionAddObject(condition,word,amount); // add item as an object
-                                            word = strtok(NULL," "); // read the next word
-                                            if (word == NULL){ // terminate
-                                                sequenceAddCondition(condition_sequence, *condition);
-                                                condition = initializeCondition();
-                                                addConditionSequence(&condition_sequence_list,condition_sequence, &condition_array_size, &condition_sequence_count);
-                                                condition_sequence = initializeConditionSequence();
-                                                break;
-                                            }
-                                                // After the "and" there may be next item or next sentence
-                                                // If the word is a number than "amount != -1" so code will continue to store objects
-                                                // If the word is not a number then loop won't continue to take objects
-                                            else if(strcmp(word,"and") == 0){
-                                                word = strtok(NULL," ");
-                                                if (word == NULL){
-                                                    invalid = true;
-                                                }
-                                                amount = getNum(word);
-                                                continue;
-                                            }
-                                        }
-                                        if (word != NULL){ // after taking the last object add condition to the sequence
-                                            sequenceAddCondition(condition_sequence, *condition);
-                                            condition = initializeCondition();
-                                        }
-                                    }
-                                    else{ // If it is invalid
-                                        invalid = true;
-                                    }
-                                }
-
-                                    // Since after an "and" we may have an action sentence we have to iterate it
-                                    // In that case our current condition subjects are actually action subjects and our current word is an action keyword
-                                    // That is why we have to go back action keywords
-                                else if (strcmp(word, "go") == 0 || strcmp(word, "sell") == 0 || strcmp(word, "buy") == 0){
-
-                                    // However we have to be careful about "action sequence if action sequence" case
-                                    if (condition_sequence->condition_count == 0){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    // our condition subjects were actually the subjects of the next action
-                                    for (int i = 0; i < condition->num_of_subjects; ++i) {
-                                        action->subjects[i] = strdup(condition->subjects[i]);
-                                    }
-                                    action->num_of_subjects = condition->num_of_subjects;
-                                    action->subj_array_size = condition->subj_array_size;
-                                    condition = initializeCondition(); // reset the condition
-                                    // add condition to the condition sequence
-                                    addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                    condition_sequence = initializeConditionSequence();
-                                    goto action_keywords;
-                                }
-                                else{ // the keyword is invalid
-                                    invalid = true;
-                                    break;
-                                }
-                            }
-
-                        }
-                        else if (strcmp(word,"to") == 0){
-                            action->mode = "sell to";
-                            word = strtok(NULL," "); // current word is trader
-                            if (word == NULL){
-                                invalid = true;
-                                break;
-                            }
-                            if(!checkFormat(word)){ // check if trader is valid
-                                invalid = true;
-                                break;
-                            }
-                            for (int i = 0; i < action->num_of_subjects; ++i) {
-                                if (strcmp(word, action->subjects[i]) == 0){ // trader can not be a subject
-                                    invalid = true;
-                                    break;
-                                }
-                            }
-                            action->trader = word;
-                            sequenceAddAction(action_sequence,*action); // add action to sequence
-                            action = initializeAction();
-                            // sell to operation is over next word is either "if" or "and"
-                            word = strtok(NULL," ");
-                            if (word == NULL){ // Terminate
-                                addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                                action_sequence = initializeActionSequence();
-                                break;
-                            }
-                            else if(strcmp(word,"and") == 0){ // new action statement
-                                break; // begin the new action statement
-                            }
-                            else if (strcmp(word,"if") == 0){ /// Condition
-                                // Add action sequence to action_sequence_list
-                                addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                                action_sequence = initializeActionSequence();
-                                /// Continue with conditional statement
-                                word = strtok(NULL, " ");
-                                if (word == NULL){ // If there is no word after "if" it is invalid
-                                    invalid = true;
-                                }
-                                //Each while loop will begin with a subject of a conditional statement
-                                while (word != NULL){ // Current word is the subject of a conditional statement
-                                    if(!checkFormat(word)){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    conditionAddSubject(condition, word);// If subject is valid add it to condition
-                                    word = strtok(NULL," "); // Take the next word which is keyword
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    // If keyword is "and" then there are more subjects to process so continue from the beginning of the while loop
-                                    if (strcmp("and",word) == 0){
-                                        word = strtok(NULL," ");
-                                        continue;
-                                    }
-
-                                        // if the keyword is "at" then we will question its location
-                                    else if (strcmp("at",word) == 0){
-                                        // Format will be "subject(s) at location"
-                                        condition->mode = "at";
-                                        word = strtok(NULL," "); // read the next word which is location
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if(!checkFormat(word)){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        conditionAddObject(condition,word,1); // add location to condition
-                                        word = strtok(NULL," ");
-                                        if (word == NULL){ // Terminate
-                                            sequenceAddCondition(condition_sequence, *condition); // add condition to sequence
-                                            condition = initializeCondition();
-                                            addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                            condition_sequence = initializeConditionSequence();
-                                            break;
-                                        }
-                                        else if (strcmp(word,"and") == 0){ //
-                                            sequenceAddCondition(condition_sequence,*condition); // add condition to sequence
-                                            condition = initializeCondition();
-                                            word = strtok(NULL," ");
-                                            if (word == NULL){
-                                                invalid = true;
-                                            }
-                                            continue;
-                                        }
-                                    }
-
-                                        // If the next word is "has" then there are 3 possibilities:
-                                        // has, has more than, has less than
-                                    else if (strcmp(word,"has") == 0){
-                                        condition->mode = "has";
-                                        word = strtok(NULL, " "); // read the word after "has"
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if (strcmp(word, "more") == 0){ // if the word is "more"
-                                            condition->mode = "has more";
-                                            word = strtok(NULL," ");
-                                            if(word == NULL){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            if (strcmp(word,"than") != 0){ // after "more" there should be "than"
-                                                invalid = true;
-                                                break;
-                                            }
-                                            word = strtok(NULL," "); // read the next word which is the amount of object
-                                        }
-                                        else if (strcmp(word, "less") == 0){ // if the word is "less"
-                                            condition->mode = "has less";
-                                            word = strtok(NULL," ");
-                                            if(word == NULL){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            if (strcmp(word,"than") != 0){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            word = strtok(NULL," ");// read the next word which is the amount of object
-                                        }
-
-                                        // Our current word is supposed to be the amount of first object
-                                        if (word == NULL){
-                                            invalid = true;
-                                        }
-                                        int amount = getNum(word); // getNum is a method that returns -1 if the number is invalid
-                                        if (amount != -1){ // If the number is valid
-                                            while(amount != -1){
-                                                word = strtok(NULL," "); // read the next word which is the item
-                                                if(word == NULL){
-                                                    invalid = true;
-                                                    break;
-                                                }
-                                                if(!checkFormat(word)){
-                                                    invalid = true;
-                                                    break;
-                                                }
-                                                conditionAddObject(condition,word,amount); // add item as an object
-                                                word = strtok(NULL," "); // read the next word
-                                                if (word == NULL){ // terminate
-                                                    sequenceAddCondition(condition_sequence, *condition);
-                                                    condition = initializeCondition();
-                                                    addConditionSequence(&condition_sequence_list,condition_sequence, &condition_array_size, &condition_sequence_count);
-                                                    condition_sequence = initializeConditionSequence();
-                                                    break;
-                                                }
-                                                    // After the "and" there may be next item or next sentence
-                                                    // If the word is a number than "amount != -1" so code will continue to store objects
-                                                    // If the word is not a number then loop won't continue to take objects
-                                                else if(strcmp(word,"and") == 0){
-                                                    word = strtok(NULL," ");
-                                                    if (word == NULL){
-                                                        invalid = true;
-                                                    }
-                                                    amount = getNum(word);
-                                                    continue;
-                                                }
-                                            }
-                                            if (word != NULL){ // after taking the last object add condition to the sequence
-                                                sequenceAddCondition(condition_sequence, *condition);
-                                                condition = initializeCondition();
-                                            }
-                                        }
-                                        else{ // If it is invalid
-                                            invalid = true;
-                                        }
-                                    }
-
-                                        // Since after an "and" we may have an action sentence we have to iterate it
-                                        // In that case our current condition subjects are actually action subjects and our current word is an action keyword
-                                        // That is why we have to go back action keywords
-                                    else if (strcmp(word, "go") == 0 || strcmp(word, "sell") == 0 || strcmp(word, "buy") == 0){
-
-                                        // However we have to be careful about "action sequence if action sequence" case
-                                        if (condition_sequence->condition_count == 0){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        // our condition subjects were actually the subjects of the next action
-                                        for (int i = 0; i < condition->num_of_subjects; ++i) {
-                                            action->subjects[i] = strdup(condition->subjects[i]);
-                                        }
-                                        action->num_of_subjects = condition->num_of_subjects;
-                                        action->subj_array_size = condition->subj_array_size;
-                                        condition = initializeCondition(); // reset the condition
-                                        // add condition to the condition sequence
-                                        addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                        condition_sequence = initializeConditionSequence();
-                                        goto action_keywords;
-                                    }
-                                    else{ // the keyword is invalid
-                                        invalid = true;
-                                        break;
-                                    }
-                                }
-
-                            }
-                            else{
-                                invalid = true;
-                                break;
-                            }
-                        }
-                        else{
-                            invalid = true;
-                            break;
-                        }
-                    }
-                    // Sell operation is over continue with the next action
-                }
-                else if (strcmp(word, "buy") == 0){
-                    action->mode = "buy";
-                    word = strtok(NULL," "); // current word is the amount
-                    int amount = getNum(word);
-                    if (amount == -1){ // check whether it is valid
-                        invalid = true;
-                        break;
-                    }
-                    while (getNum(word) != -1){ // each loop begins with amount
-                        word = strtok(NULL," "); // next word is the item name
-                        if (word == NULL){
-                            invalid = true;
-                            break;
-                        }
-                        if(!checkFormat(word)){ // check if the item is valid
-                            invalid = true;
-                            break;
-                        }
-                        actionAddObject(action,word,amount); // add the new object
-                        word = strtok(NULL," ");
-                        if (word == NULL){// Terminate
-                            sequenceAddAction(action_sequence,*action); // add action to sequence
-                            action = initializeAction();
-                            // add action sequence to action_sequence_list
-                            addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                            action_sequence = initializeActionSequence();
-                            break;
-                        }
-                        // If the next word is "and" we should either get another item or new action statement
-                        if(strcmp(word,"and") == 0){
-                            word = strtok(NULL," "); // If it is a number we get another item otherwise an action statement
-                            if (word == NULL){
-                                invalid = true;
-                                break;
-                            }
-                            amount = getNum(word);
-                            if (amount == -1){ // new action statement
-                                sequenceAddAction(action_sequence,*action); // add action to sequence
-                                action = initializeAction();
-                                break; // break the loop that takes objects and return the loop that takes subjects
-                            }
-                            continue; // if it is a number continue taking objects
-                        }
-
-                        else if (strcmp(word,"if") == 0){ /// Condition
-                            sequenceAddAction(action_sequence,*action); // add action to sequence
-                            action = initializeAction(); // create a new action
-                            // Add action sequence to action_sequence_list
-                            addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                            action_sequence = initializeActionSequence();
-                            /// Continue with conditional statement
-                            word = strtok(NULL, " ");
-                            if (word == NULL){ // If there is no word after "if" it is invalid
-                                invalid = true;
-                            }
-                            //Each while loop will begin with a subject of a conditional statement
-                            while (word != NULL){ // Current word is the subject of a conditional statement
-                                if(!checkFormat(word)){
-                                    invalid = true;
-                                    break;
-                                }
-                                conditionAddSubject(condition, word);// If subject is valid add it to condition
-                                word = strtok(NULL," "); // Take the next word which is keyword
-                                if(word == NULL){
-                                    invalid = true;
-                                    break;
-                                }
-                                // If keyword is "and" then there are more subjects to process so continue from the beginning of the while loop
-                                if (strcmp("and",word) == 0){
-                                    word = strtok(NULL," ");
-                                    continue;
-                                }
-
-                                    // if the keyword is "at" then we will question its location
-                                else if (strcmp("at",word) == 0){
-                                    // Format will be "subject(s) at location"
-                                    condition->mode = "at";
-                                    word = strtok(NULL," "); // read the next word which is location
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    if(!checkFormat(word)){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    conditionAddObject(condition,word,1); // add location to condition
-                                    word = strtok(NULL," ");
-                                    if (word == NULL){ // Terminate
-                                        sequenceAddCondition(condition_sequence, *condition); // add condition to sequence
-                                        condition = initializeCondition();
-                                        addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                        condition_sequence = initializeConditionSequence();
-                                        break;
-                                    }
-                                    else if (strcmp(word,"and") == 0){ //
-                                        sequenceAddCondition(condition_sequence,*condition); // add condition to sequence
-                                        condition = initializeCondition();
-                                        word = strtok(NULL," ");
-                                        if (word == NULL){
-                                            invalid = true;
-                                        }
-                                        continue;
-                                    }
-                                }
-
-                                    // If the next word is "has" then there are 3 possibilities:
-                                    // has, has more than, has less than
-                                else if (strcmp(word,"has") == 0){
-                                    condition->mode = "has";
-                                    word = strtok(NULL, " "); // read the word after "has"
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    if (strcmp(word, "more") == 0){ // if the word is "more"
-                                        condition->mode = "has more";
-                                        word = strtok(NULL," ");
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if (strcmp(word,"than") != 0){ // after "more" there should be "than"
-                                            invalid = true;
-                                            break;
-                                        }
-                                        word = strtok(NULL," "); // read the next word which is the amount of object
-                                    }
-                                    else if (strcmp(word, "less") == 0){ // if the word is "less"
-                                        condition->mode = "has less";
-                                        word = strtok(NULL," ");
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if (strcmp(word,"than") != 0){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        word = strtok(NULL," ");// read the next word which is the amount of object
-                                    }
-
-                                    // Our current word is supposed to be the amount of first object
-                                    if (word == NULL){
-                                        invalid = true;
-                                    }
-                                    int amount = getNum(word); // getNum is a method that returns -1 if the number is invalid
-                                    if (amount != -1){ // If the number is valid
-                                        while(amount != -1){
-                                            word = strtok(NULL," "); // read the next word which is the item
-                                            if(word == NULL){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            if(!checkFormat(word)){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            conditionAddObject(condition,word,amount); // add item as an object
-                                            word = strtok(NULL," "); // read the next word
-                                            if (word == NULL){ // terminate
-                                                sequenceAddCondition(condition_sequence, *condition);
-                                                condition = initializeCondition();
-                                                addConditionSequence(&condition_sequence_list,condition_sequence, &condition_array_size, &condition_sequence_count);
-                                                condition_sequence = initializeConditionSequence();
-                                                break;
-                                            }
-                                                // After the "and" there may be next item or next sentence
-                                                // If the word is a number than "amount != -1" so code will continue to store objects
-                                                // If the word is not a number then loop won't continue to take objects
-                                            else if(strcmp(word,"and") == 0){
-                                                word = strtok(NULL," ");
-                                                if (word == NULL){
-                                                    invalid = true;
-                                                }
-                                                amount = getNum(word);
-                                                continue;
-                                            }
-                                        }
-                                        if (word != NULL){ // after taking the last object add condition to the sequence
-                                            sequenceAddCondition(condition_sequence, *condition);
-                                            condition = initializeCondition();
-                                        }
-                                    }
-                                    else{ // If it is invalid
-                                        invalid = true;
-                                    }
-                                }
-
-                                    // Since after an "and" we may have an action sentence we have to iterate it
-                                    // In that case our current condition subjects are actually action subjects and our current word is an action keyword
-                                    // That is why we have to go back action keywords
-                                else if (strcmp(word, "go") == 0 || strcmp(word, "sell") == 0 || strcmp(word, "buy") == 0){
-
-                                    // However we have to be careful about "action sequence if action sequence" case
-                                    if (condition_sequence->condition_count == 0){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    // our condition subjects were actually the subjects of the next action
-                                    for (int i = 0; i < condition->num_of_subjects; ++i) {
-                                        action->subjects[i] = strdup(condition->subjects[i]);
-                                    }
-                                    action->num_of_subjects = condition->num_of_subjects;
-                                    action->subj_array_size = condition->subj_array_size;
-                                    condition = initializeCondition(); // reset the condition
-                                    // add condition to the condition sequence
-                                    addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                    condition_sequence = initializeConditionSequence();
-                                    goto action_keywords;
-                                }
-                                else{ // the keyword is invalid
-                                    invalid = true;
-                                    break;
-                                }
-                            }
-
-                        }
-                        else if (strcmp(word,"from") == 0){
-                            action->mode = "buy from";
-                            word = strtok(NULL," "); // next word should be trader
-                            if (word == NULL){
-                                invalid = true;
-                                break;
-                            }
-                            if(!checkFormat(word)){ // check whether trader is valid or not
-                                invalid = true;
-                                break;
-                            }
-                            for (int i = 0; i < action->num_of_subjects; ++i) { // if trader is one of subjects then invalid
-                                if (strcmp(word, action->subjects[i]) == 0){
-                                    invalid = true;
-                                    break;
-                                }
-                            }
-                            action->trader = word;
-                            sequenceAddAction(action_sequence,*action); // add action to sequence
-                            action = initializeAction();
-                            word = strtok(NULL," "); // the next word is either "and" or "if"
-                            if (word == NULL){ // Terminate
-                                addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                                action_sequence = initializeActionSequence();
-                                break;
-                            }
-                            else if(strcmp(word,"and") == 0){ // new action statement
-                                break; // begin the new action statement
-                            }
-                            else if (strcmp(word,"if") == 0){ /// Condition
-                                // Add action sequence to action_sequence_list
-                                addActionSequence(&action_sequence_list,action_sequence,&action_array_size,&action_sequence_count);
-                                action_sequence = initializeActionSequence();
-                                /// Continue with conditional statement
-                                word = strtok(NULL, " ");
-                                if (word == NULL){ // If there is no word after "if" it is invalid
-                                    invalid = true;
-                                }
-                                //Each while loop will begin with a subject of a conditional statement
-                                while (word != NULL){ // Current word is the subject of a conditional statement
-                                    if(!checkFormat(word)){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    conditionAddSubject(condition, word);// If subject is valid add it to condition
-                                    word = strtok(NULL," "); // Take the next word which is keyword
-                                    if(word == NULL){
-                                        invalid = true;
-                                        break;
-                                    }
-                                    // If keyword is "and" then there are more subjects to process so continue from the beginning of the while loop
-                                    if (strcmp("and",word) == 0){
-                                        word = strtok(NULL," ");
-                                        continue;
-                                    }
-
-                                        // if the keyword is "at" then we will question its location
-                                    else if (strcmp("at",word) == 0){
-                                        // Format will be "subject(s) at location"
-                                        condition->mode = "at";
-                                        word = strtok(NULL," "); // read the next word which is location
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if(!checkFormat(word)){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        conditionAddObject(condition,word,1); // add location to condition
-                                        word = strtok(NULL," ");
-                                        if (word == NULL){ // Terminate
-                                            sequenceAddCondition(condition_sequence, *condition); // add condition to sequence
-                                            condition = initializeCondition();
-                                            addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                            condition_sequence = initializeConditionSequence();
-                                            break;
-                                        }
-                                        else if (strcmp(word,"and") == 0){ //
-                                            sequenceAddCondition(condition_sequence,*condition); // add condition to sequence
-                                            condition = initializeCondition();
-                                            word = strtok(NULL," ");
-                                            if (word == NULL){
-                                                invalid = true;
-                                            }
-                                            continue;
-                                        }
-                                    }
-
-                                        // If the next word is "has" then there are 3 possibilities:
-                                        // has, has more than, has less than
-                                    else if (strcmp(word,"has") == 0){
-                                        condition->mode = "has";
-                                        word = strtok(NULL, " "); // read the word after "has"
-                                        if(word == NULL){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        if (strcmp(word, "more") == 0){ // if the word is "more"
-                                            condition->mode = "has more";
-                                            word = strtok(NULL," ");
-                                            if(word == NULL){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            if (strcmp(word,"than") != 0){ // after "more" there should be "than"
-                                                invalid = true;
-                                                break;
-                                            }
-                                            word = strtok(NULL," "); // read the next word which is the amount of object
-                                        }
-                                        else if (strcmp(word, "less") == 0){ // if the word is "less"
-                                            condition->mode = "has less";
-                                            word = strtok(NULL," ");
-                                            if(word == NULL){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            if (strcmp(word,"than") != 0){
-                                                invalid = true;
-                                                break;
-                                            }
-                                            word = strtok(NULL," ");// read the next word which is the amount of object
-                                        }
-
-                                        // Our current word is supposed to be the amount of first object
-                                        if (word == NULL){
-                                            invalid = true;
-                                        }
-                                        int amount = getNum(word); // getNum is a method that returns -1 if the number is invalid
-                                        if (amount != -1){ // If the number is valid
-                                            while(amount != -1){
-                                                word = strtok(NULL," "); // read the next word which is the item
-                                                if(word == NULL){
-                                                    invalid = true;
-                                                    break;
-                                                }
-                                                if(!checkFormat(word)){
-                                                    invalid = true;
-                                                    break;
-                                                }
-                                                conditionAddObject(condition,word,amount); // add item as an object
-                                                word = strtok(NULL," "); // read the next word
-                                                if (word == NULL){ // terminate
-                                                    sequenceAddCondition(condition_sequence, *condition);
-                                                    condition = initializeCondition();
-                                                    addConditionSequence(&condition_sequence_list,condition_sequence, &condition_array_size, &condition_sequence_count);
-                                                    condition_sequence = initializeConditionSequence();
-                                                    break;
-                                                }
-                                                    // After the "and" there may be next item or next sentence
-                                                    // If the word is a number than "amount != -1" so code will continue to store objects
-                                                    // If the word is not a number then loop won't continue to take objects
-                                                else if(strcmp(word,"and") == 0){
-                                                    word = strtok(NULL," ");
-                                                    if (word == NULL){
-                                                        invalid = true;
-                                                    }
-                                                    amount = getNum(word);
-                                                    continue;
-                                                }
-                                            }
-                                            if (word != NULL){ // after taking the last object add condition to the sequence
-                                                sequenceAddCondition(condition_sequence, *condition);
-                                                condition = initializeCondition();
-                                            }
-                                        }
-                                        else{ // If it is invalid
-                                            invalid = true;
-                                        }
-                                    }
-
-                                        // Since after an "and" we may have an action sentence we have to iterate it
-                                        // In that case our current condition subjects are actually action subjects and our current word is an action keyword
-                                        // That is why we have to go back action keywords
-                                    else if (strcmp(word, "go") == 0 || strcmp(word, "sell") == 0 || strcmp(word, "buy") == 0){
-
-                                        // However we have to be careful about "action sequence if action sequence" case
-                                        if (condition_sequence->condition_count == 0){
-                                            invalid = true;
-                                            break;
-                                        }
-                                        // our condition subjects were actually the subjects of the next action
-                                        for (int i = 0; i < condition->num_of_subjects; ++i) {
-                                            action->subjects[i] = strdup(condition->subjects[i]);
-                                        }
-                                        action->num_of_subjects = condition->num_of_subjects;
-                                        action->subj_array_size = condition->subj_array_size;
-                                        condition = initializeCondition(); // reset the condition
-                                        // add condition to the condition sequence
-                                        addConditionSequence(&condition_sequence_list,condition_sequence,&condition_array_size,&condition_sequence_count);
-                                        condition_sequence = initializeConditionSequence();
-                                        goto action_keywords;
-                                    }
-                                    else{ // the keyword is invalid
-                                        invalid = true;
-                                        break;
-                                    }
-                                }
-
-                            }
-                            else{
-                                invalid = true;
-                                break;
-                            }
-                        }
-                        else{
-                            invalid = true;
-                            break;
-                        }
-                    }
-                }
-                else{
-                    invalid = true;
-                }
-            }
+// Constructor of the person registry
+struct Person_Registry *initializeRegistry(){
+    struct Person_Registry *registry = calloc(1, sizeof(struct Person_Registry));
+    registry->people_count = 0;
+    registry->array_size = INITIAL_ARRAY_SIZE;
+    registry->names = calloc(registry->array_size, sizeof(int));
+    registry->ranks = calloc(registry->array_size, sizeof(int));
+    registry->locations = calloc(registry->array_size, sizeof(int));
+    registry->inventories = calloc(registry->array_size, sizeof(struct Inventory));
+    registry->slot_count = INITIAL_SLOT_COUNT;
+    registry->slots = allocateSlots(registry->slot_count);
+    registry->residents_array_size = 0; // residents are allocated when someone goes to a location
+    registry->residents = NULL;
+    registry->rank_count = 0;
+    registry->place_array_size = INITIAL_ARRAY_SIZE; // columns and places are allocated when a plan uses them
+    return registry;
+}
 
+// returns the handle of a person or -1 if there is no such person
+int lookupPerson(struct Person_Registry *registry, int name){
+    // the count is loaded before the table, a table that is replaced meanwhile is probed at most once around
+    int slot_count = ACQUIRE(registry->slot_count);
+    int *slots = ACQUIRE(registry->slots);
+    unsigned int mask = slot_count - 1;
+    // linear probing until we find the person or an empty slot
+    unsigned int slot = hashId(name) & mask;
+    for (int probe = 0; probe < slot_count; ++probe, slot = (slot + 1) & mask) {
+        int handle = ACQUIRE(slots[slot]);
+        if (handle == -1){
+            return -1;
+        }
+        if (handle < ACQUIRE(registry->people_count) && ACQUIRE(registry->names)[handle] == name) {
+            return handle;
+        }
+    }
+    return -1;
+}
 
-            // There should not be any duplicate items or subjects for each action and condition
-            for (int i = 0; i < condition_sequence_count; ++i) { // For each condition sequence
-                struct Condition_Sequence *seq = condition_sequence_list[i];
-                for (int j = 0; j < seq->condition_count; ++j) { // For each condition
-                    struct Condition *cond = seq->conditions[j];
-                    if (hasDuplicates(cond->subjects,cond->num_of_subjects)){
-                        invalid = true;
-                    }
-                    if (hasDuplicates(cond->objects,cond->num_of_objects)){
-                        invalid = true;
-                    }
-                }
-            }
-            for (int i = 0; i < action_sequence_count; ++i) { // For each action sequence
-                struct Action_Sequence *seq = action_sequence_list[i];
-                for (int j = 0; j < seq->action_count; ++j) { // For each action
-                    struct Action *act = seq->actions[j];
-                    if (hasDuplicates(act->subjects,act->num_of_subjects)){
-                        invalid = true;
-                    }
-                    if (hasDuplicates(act->objects,act->num_of_objects)){
-                        invalid = true;
-                    }
-                }
+// Finds a person in the registry and if the person does not exist creates its data, returns its handle
+int findPerson(struct Person_Registry *registry, int name) {
+    return usePerson(registry, resolvePerson(registry, name));
+}
 
-            }
+// returns the handle of the person with the given name, creates it if it does not exist without giving it a rank
+int resolvePerson(struct Person_Registry *registry, int name) {
+    int handle = lookupPerson(registry, name);
+    if (handle != -1) {
+        return handle;
+    }
+    // Person not found, create a new one
+    createPerson(registry, name);
+    return registry->people_count - 1;
+}
 
+// returns the handle of a person after giving it the next rank if it is used for the first time
+// Plans resolve every name when they are compiled, ranks keep who at in the order people were first used by a statement
+int usePerson(struct Person_Registry *registry, int handle) {
+    if (registry->ranks[handle] == -1) {
+        registry->ranks[handle] = registry->rank_count++;
+    }
+    return handle;
+}
 
-            if (invalid){
-                printf("%s\n", "INVALID");
-                fflush(stdout);
-            }
-            else{
-                for (int i = 0; i < condition_sequence_count; ++i) { //For each condition sequence
-                    // if condition sequence is true process the action sequence
-                    if (checkConditionSequence(condition_sequence_list[i],&people,&people_count,&people_array_size)){
-                        processActionSequence(*action_sequence_list[i],&people,&people_count,&people_array_size);
-                    }
-                }
-                // if the last sequence is action sequence process it
-                if (action_sequence_count > condition_sequence_count){
-                    processActionSequence(*action_sequence_list[action_sequence_count-1],&people,&people_count,&people_array_size);
-                }
-                printf("%s\n", "OK");
-                fflush(stdout);
-            }
+// Creates a person at the next handle of every array, without a rank and at NOWHERE
+// Called by resolvePerson for a name that is not found and by loadSnapshot, which then sets the rank and location itself
+void createPerson(struct Person_Registry *registry, int name){
+    beginWrite();
+    // Keep the load factor of the hash table at most one half
+    if ((registry->people_count + 1) * 2 > registry->slot_count){
+        growRegistrySlots(registry);
+    }
+    // The new person is the next index of every array
+    int handle = registry->people_count;
+    if (handle + 1 == registry->array_size){ // If arrays are almost full reallocate them
+        size_t old_size = registry->array_size;
+        registry->array_size *= 2;
+        PUBLISH(registry->names, growShared(registry->names, sizeof(int) * old_size, sizeof(int) * registry->array_size));
+        PUBLISH(registry->ranks, growShared(registry->ranks, sizeof(int) * old_size, sizeof(int) * registry->array_size));
+        PUBLISH(registry->locations, growShared(registry->locations, sizeof(int) * old_size, sizeof(int) * registry->array_size));
+        PUBLISH(registry->inventories, growShared(registry->inventories, sizeof(struct Inventory) * old_size, sizeof(struct Inventory) * registry->array_size));
+    }
+    registry->names[handle] = name;
+    registry->ranks[handle] = -1;
+    registry->locations[handle] = NOWHERE_SYMBOL;
+    struct Inventory *inventory = &registry->inventories[handle];
+    inventory->item_count = 0;
+    inventory->item_array_size = INITIAL_ARRAY_SIZE;
+    inventory->items = calloc(INITIAL_ARRAY_SIZE, sizeof(int));
+    inventory->amounts = calloc(INITIAL_ARRAY_SIZE, sizeof(int));
+    inventory->rows = calloc(INITIAL_ARRAY_SIZE, sizeof(int));
+    inventory->item_slot_count = INITIAL_ITEM_SLOT_COUNT;
+    inventory->item_slots = allocateSlots(inventory->item_slot_count);
+    // Then count it and index its handle
+    PUBLISH(registry->people_count, handle + 1);
+    insertSlot(registry->slots, registry->slot_count, hashId(name), handle);
+    endWrite();
+}
 
+// Doubles the hash table of the registry and reinserts every handle
+void growRegistrySlots(struct Person_Registry *registry){
+    int slot_count = registry->slot_count * 2;
+    int *slots = allocateSlots(slot_count);
+    for (int handle = 0; handle < registry->people_count; ++handle) {
+        insertSlot(slots, slot_count, hashId(registry->names[handle]), handle);
+    }
+    retireShared(registry->slots);
+    PUBLISH(registry->slots, slots); // the table is replaced before its count grows, see lookupPerson
+    PUBLISH(registry->slot_count, slot_count);
+}
 
+// Allocates a hash table in which every slot is empty
+int *allocateSlots(int slot_count){
+    int *slots = malloc(slot_count * sizeof(int));
+    memset(slots, -1, slot_count * sizeof(int)); // -1 marks an empty slot
+    return slots;
+}
 
-            // free the allocated memory
-            freeAction(action);
-            freeCondition(condition);
+// Puts a value to the first empty slot after its hash (linear probing)
+// The value is published so a reader that finds it also sees what it indexes
+void insertSlot(int *slots, int slot_count, unsigned int hash, int value){
+    unsigned int mask = slot_count - 1;
+    unsigned int slot = hash & mask;
+    while (slots[slot] != -1){
+        slot = (slot + 1) & mask;
+    }
+    PUBLISH(slots[slot], value);
+}
 
-            for (int i = 0; i < action_sequence_count; ++i) {
-                freeActionSequence(action_sequence_list[i]);
-            }
-            free(action_sequence_list);
+// Adds a new item to the inventory of a person, row is the row of the person in the column of the item
+void addItem(struct Inventory *inventory, int item, int amount, int row){
+    // Keep the load factor of the item hash table at most one half
+    if ((inventory->item_count + 1) * 2 > inventory->item_slot_count){
+        growItemSlots(inventory);
+    }
+    int index = inventory->item_count;
+    if (index + 1 == inventory->item_array_size){ // If array is almost full reallocate it
+        inventory->item_array_size *= 2;
+        PUBLISH(inventory->items, growShared(inventory->items, sizeof(int) * (inventory->item_array_size / 2), sizeof(int) * (inventory->item_array_size)));
+        PUBLISH(inventory->amounts, growShared(inventory->amounts, sizeof(int) * (inventory->item_array_size / 2), sizeof(int) * (inventory->item_array_size)));
+        inventory->rows = growShared(inventory->rows, sizeof(int) * (inventory->item_array_size / 2), sizeof(int) * (inventory->item_array_size));
+    }
+    // Add the item
+    // a rollback removes the last item, so a reader that counted it before may still read the index that is filled again here
+    __atomic_store_n(&inventory->items[index], item, __ATOMIC_RELAXED); // items are interned no need to allocate
+    __atomic_store_n(&inventory->amounts[index], amount, __ATOMIC_RELAXED); // amount is integer no need to allocate
+    inventory->rows[index] = row;
+    PUBLISH(inventory->item_count, index + 1); // Update the number of items
+    insertSlot(inventory->item_slots, inventory->item_slot_count, hashId(item), index);
+}
+
+// Doubles the item hash table of an inventory and reinserts every item index
+void growItemSlots(struct Inventory *inventory){
+    int slot_count = inventory->item_slot_count * 2;
+    int *slots = allocateSlots(slot_count);
+    for (int i = 0; i < inventory->item_count; ++i) {
+        insertSlot(slots, slot_count, hashId(inventory->items[i]), i);
+    }
+    retireShared(inventory->item_slots);
+    PUBLISH(inventory->item_slots, slots); // the table is replaced before its count grows, see getItemIndex
+    PUBLISH(inventory->item_slot_count, slot_count);
+}
+
+// Removes the item that was added last to an inventory, only rollback takes an item away
+// No item was inserted into the hash table after it, so emptying its slot does not break the probing of another item
+void removeLastItem(struct Inventory *inventory){
+    int index = inventory->item_count - 1;
+    unsigned int mask = inventory->item_slot_count - 1;
+    unsigned int slot = hashId(inventory->items[index]) & mask;
+    while (inventory->item_slots[slot] != index){
+        slot = (slot + 1) & mask;
+    }
+    PUBLISH(inventory->item_count, index); // a reader that still finds the slot sees that the index is not counted
+    PUBLISH(inventory->item_slots[slot], -1);
+}
 
-            for (int i = 0; i < condition_sequence_count; ++i) {
-                freeConditionSequence(condition_sequence_list[i]);
+// writes out all the people in a specific location
+void who_at(struct Person_Registry *registry, int location){
+    bool found = false;
+    // a location that was never interned or that nobody went to has no residents
+    if (location != -1 && location < ACQUIRE(registry->residents_array_size)){
+        struct Residents *residents = &ACQUIRE(registry->residents)[location];
+        int count = ACQUIRE(residents->count);
+        int *handles = ACQUIRE(residents->handles);
+        int people_count = ACQUIRE(registry->people_count);
+        int *names = ACQUIRE(registry->names);
+        for (int i = 0; i < count; i++){
+            int handle = __atomic_load_n(&handles[i], __ATOMIC_RELAXED); // the writer moves handles in place, see moveHandles
+            if (handle < 0 || handle >= people_count){ // the writer moved people meanwhile, see answerConcurrently
+                torn_read = true;
+                break;
+            }
+            if(!found){
+                writeString(symbolName(names[handle]));
+                found = true;
             }
-            free(condition_sequence_list);
+            else{
+                writeString(" and ");
+                writeString(symbolName(names[handle]));
+            }
+        }
+    }
+    if (!found){ // if no one is found
+        writeString("NOBODY");
+    }
+    endResponse();
+}
+
+// Changes the location of a person and moves its handle between the residents of both locations
+void movePerson(struct Person_Registry *registry, int person, int location){
+    int current = registry->locations[person];
+    if (current == location){
+        return;
+    }
+    // the amounts the person has move from the totals of the old place to the new one
+    struct Inventory *inventory = &registry->inventories[person];
+    for (int i = 0; i < inventory->item_count; ++i) {
+        long long *place_totals = registry->columns[inventory->items[i]]->place_totals;
+        if (inventory->amounts[i] == 0){
+            continue;
+        }
+        if (current != NOWHERE_SYMBOL){
+            addTotal(&place_totals[registry->places[current]], -inventory->amounts[i]);
+        }
+        if (location != NOWHERE_SYMBOL){
+            addTotal(&place_totals[registry->places[location]], inventory->amounts[i]);
         }
-
-
     }
-
-    // free the allocated memory
-    for (int i = 0; i < people_count; ++i) {
-        freePerson(people[i]);
+    if (current != NOWHERE_SYMBOL){ // people at NOWHERE are not indexed
+        struct Residents *old = &registry->residents[current];
+        int index = findResident(registry, old, registry->ranks[person]);
+        moveHandles(old->handles, index, index + 1, old->count - index - 1);
+        PUBLISH(old->count, old->count - 1);
+    }
+    PUBLISH(registry->locations[person], location);
+    if (location == NOWHERE_SYMBOL){ // only a rollback takes someone back to NOWHERE
+        return;
+    }
+    // If the location is not covered by the residents array reallocate it, the size is changed last for readers
+    if (location >= registry->residents_array_size){
+        int old_size = registry->residents_array_size;
+        int new_size = symbol_table->array_size; // enough for every interned string
+        struct Residents *grown = growShared(registry->residents, old_size * sizeof(struct Residents), new_size * sizeof(struct Residents));
+        memset(&grown[old_size], 0, (new_size - old_size) * sizeof(struct Residents));
+        PUBLISH(registry->residents, grown);
+        PUBLISH(registry->residents_array_size, new_size);
     }
-    free(people);
+    struct Residents *residents = &registry->residents[location];
+    if (residents->count == residents->array_size){ // If array is full reallocate it
+        int old_size = residents->array_size;
+        residents->array_size = old_size == 0 ? INITIAL_ARRAY_SIZE : old_size * 2;
+        PUBLISH(residents->handles, growShared(residents->handles, old_size * sizeof(int), residents->array_size * sizeof(int)));
+    }
+    // keep the handles sorted by rank so that who at lists people in the order they were first used
+    int index = findResident(registry, residents, registry->ranks[person]);
+    moveHandles(residents->handles, index + 1, index, residents->count - index);
+    __atomic_store_n(&residents->handles[index], person, __ATOMIC_RELAXED);
+    PUBLISH(residents->count, residents->count + 1);
 }
 
-// return true if there is a duplicate in a string array
-bool hasDuplicates(char **strArray, int size) {
-    for (int i = 0; i < size - 1; i++) {
-        for (int j = i + 1; j < size; j++) {
-            if (strcmp(strArray[i], strArray[j]) == 0) {
-                return true; // Found a duplicate
-            }
+// returns the index of the first handle that is not smaller than the given handle (binary search)
+int findResident(struct Person_Registry *registry, struct Residents *residents, int rank){
+    int low = 0;
+    int high = residents->count;
+    while (low < high){
+        int middle = (low + high) / 2;
+        if (registry->ranks[residents->handles[middle]] < rank){
+            low = middle + 1;
+        }
+        else{
+            high = middle;
         }
     }
-    return false; // No duplicates found
+    return low;
 }
 
-//will return natural number equivalent of a string (invalid case returns -1)
-int getNum(char *str) {
-    if (str == NULL || *str == '\0') // Check if the string is empty or NULL
-        return -1;
-
-    char numStr[100]; // Assuming maximum length of the numeric string
-    int i = 0;
-
-    // Copy digits from str to numStr
-    while (*str != '\0') {
-        if (isdigit(*str)) {
-            numStr[i] = *str;
-            i++;
-        } else {
-            return -1; // If any character is not a digit, return -1
+// Moves count handles of a residents array from one index to another like memmove
+// Reader threads read the handles while they move, so every handle is loaded and stored atomically (a torn list is retried)
+void moveHandles(int *handles, int to, int from, int count){
+    if (to < from){
+        for (int i = 0; i < count; ++i) {
+            __atomic_store_n(&handles[to + i], handles[from + i], __ATOMIC_RELAXED);
+        }
+    }
+    else{
+        for (int i = count - 1; i >= 0; --i) {
+            __atomic_store_n(&handles[to + i], handles[from + i], __ATOMIC_RELAXED);
         }
-        str++;
     }
-    numStr[i] = '\0'; // Null-terminate the numStr
+}
 
-    // Convert the numStr to an integer
-    int num = atoi(numStr);
+// returns how many item the person has
+int getItemNumber(struct Inventory *inventory, int item){
+    int index = getItemIndex(inventory, item);
+    if( index == -1 ){
+        return 0;
+    }
+    return ACQUIRE(ACQUIRE(inventory->amounts)[index]);
+}
 
-    if (num >= 0)
-        return num;
-    else
+// returns the index of an item in the item array of an inventory
+int getItemIndex(struct Inventory *inventory, int item){
+    if (item == -1){ // the item was never interned
         return -1;
+    }
+    // the count is loaded before the table, a table that is replaced meanwhile is probed at most once around
+    int slot_count = ACQUIRE(inventory->item_slot_count);
+    int *slots = ACQUIRE(inventory->item_slots);
+    unsigned int mask = slot_count - 1;
+    // linear probing until we find the item or an empty slot
+    unsigned int slot = hashId(item) & mask;
+    for (int probe = 0; probe < slot_count; ++probe, slot = (slot + 1) & mask) {
+        int index = ACQUIRE(slots[slot]);
+        if (index == -1){
+            return -1;
+        }
+        if(index < ACQUIRE(inventory->item_count) && __atomic_load_n(&ACQUIRE(inventory->items)[index], __ATOMIC_RELAXED) == item){
+            return index;
+        }
+    }
+    return -1;
 }
 
-// checks whether a word is valid or not as a subject, object or location
-bool checkFormat(char *word){
-    // Since null case handled separately we returned true here
-    if (word == NULL){
-        return true;
+// Reserves a row in the column of every item a person of the plan may get, subjects of buy and buy from and traders of sell to,
+// and the place of every location it goes to
+// They are only added here, before the plan is executed, so a worker of a parallel batch never grows a column
+void reservePlanRows(struct Person_Registry *registry, struct Plan *plan){
+    for (int i = 0; i < plan->sequence_count; ++i) {
+        struct Plan_Sequence *sequence = &plan->sequences[i];
+        for (int j = 0; j < sequence->action_count; ++j) {
+            struct Plan_Action *action = &sequence->actions[j];
+            for (int k = 0; k < action->num_of_objects; ++k) {
+                if (action->mode == ACTION_GO_TO){
+                    reservePlace(registry, action->objects[k]);
+                }
+                else if (action->mode == ACTION_BUY || action->mode == ACTION_BUY_FROM){
+                    for (int l = 0; l < action->num_of_subjects; ++l) {
+                        reserveRow(registry, action->objects[k], action->subjects[l]);
+                    }
+                }
+                else if (action->mode == ACTION_SELL_TO){
+                    reserveRow(registry, action->objects[k], action->trader);
+                }
+            }
+        }
     }
-        // Subjects and objects can not be one of keywords
-    else if (strcmp(word, "sell") == 0 || strcmp(word, "buy") == 0 || strcmp(word, "go") == 0 || strcmp(word, "to") == 0 || strcmp(word, "from") == 0 || strcmp(word, "and") == 0 || strcmp(word, "at") == 0 || strcmp(word, "has") == 0 || strcmp(word, "if") == 0 || strcmp(word, "less") == 0 || strcmp(word, "more") == 0 || strcmp(word, "than") == 0 || strcmp(word, "exit") == 0 || strcmp(word, "where") == 0 || strcmp(word, "total") == 0 || strcmp(word, "who") == 0 || strcmp(word, "NOBODY") == 0 || strcmp(word, "NOTHING") == 0 || strcmp(word, "NOWHERE") == 0){
-        return false;
+}
+
+// returns the row of a person in the column of an item, the column and the row are created if they do not exist
+// A new row has amount 0 until the person gets the item, the totals of a new column start at 0
+int reserveRow(struct Person_Registry *registry, int item, int handle){
+    struct Item_Column *column = item < registry->column_array_size ? registry->columns[item] : NULL;
+    int row = column == NULL ? -1 : findRow(column, handle);
+    if (row != -1){
+        return row;
     }
-    // They should consist of uppercase and lowercase letters
-    for (int i = 0; i < strlen(word); ++i) {
-        char chr = *(word + i);
-        if (!(chr > 64 && chr < 91) && chr != 95 && !(chr > 96 && chr < 123)){
-            return false;
+    beginWrite();
+    if (item >= registry->column_array_size){ // If array is too small reallocate it
+        int old_size = registry->column_array_size;
+        int size = old_size > 0 ? old_size : INITIAL_ARRAY_SIZE;
+        while (size <= item){
+            size *= 2;
         }
+        struct Item_Column **columns = growShared(registry->columns, sizeof(struct Item_Column*) * old_size, sizeof(struct Item_Column*) * size);
+        memset(&columns[old_size], 0, sizeof(struct Item_Column*) * (size - old_size));
+        PUBLISH(registry->columns, columns);
+        PUBLISH(registry->column_array_size, size);
     }
-    return true;
+    if (column == NULL){
+        column = calloc(1, sizeof(struct Item_Column));
+        column->row_array_size = INITIAL_ARRAY_SIZE;
+        column->handles = calloc(column->row_array_size, sizeof(int));
+        column->amounts = calloc(column->row_array_size, sizeof(int));
+        column->slot_count = INITIAL_ITEM_SLOT_COUNT;
+        column->slots = allocateSlots(column->slot_count);
+        column->total = 0;
+        column->place_totals = calloc(registry->place_array_size, sizeof(long long));
+        PUBLISH(registry->columns[item], column); // the column is filled before a reader can find it
+    }
+    // Keep the load factor of the hash table at most one half
+    if ((column->row_count + 1) * 2 > column->slot_count){
+        growColumnSlots(column);
+    }
+    if (column->row_count + 1 == column->row_array_size){ // If arrays are almost full reallocate them
+        column->row_array_size *= 2;
+        PUBLISH(column->handles, growShared(column->handles, sizeof(int) * (column->row_array_size / 2), sizeof(int) * column->row_array_size));
+        PUBLISH(column->amounts, growShared(column->amounts, sizeof(int) * (column->row_array_size / 2), sizeof(int) * column->row_array_size));
+    }
+    row = column->row_count;
+    column->handles[row] = handle;
+    column->amounts[row] = 0;
+    PUBLISH(column->row_count, row + 1);
+    insertSlot(column->slots, column->slot_count, hashId(handle), row);
+    endWrite();
+    return row;
 }
 
-
-// Scans a people array to find a person and if the person does not exist creates its data
-struct Person *findPerson(struct Person ***people, char *name, int *people_count, int *array_size) {
-    for (int i = 0; i < *people_count; ++i) {
-        if (strcmp((*people)[i]->name, name) == 0) {
-            return (*people)[i];
+// returns the row of a person in a column or -1 if the person does not have one
+int findRow(struct Item_Column *column, int handle){
+    unsigned int mask = column->slot_count - 1;
+    // linear probing until we find the person or an empty slot
+    for (unsigned int slot = hashId(handle) & mask; column->slots[slot] != -1; slot = (slot + 1) & mask) {
+        int row = column->slots[slot];
+        if (column->handles[row] == handle){
+            return row;
         }
     }
-    // Person not found, create a new one
-    createPerson(people, name, people_count, array_size);
-    return (*people)[*people_count - 1];
-}
-
-// Only called from "findPerson" function, creates a person
-void createPerson(struct Person ***people, char *name, int *people_count, int *array_size){
-    *people_count += 1; // Update the number of people
-    if (*people_count == *array_size){ // If array is almost full reallocate it
-        *array_size *= 2;
-        *people = realloc(*people, sizeof(struct Person*) * (*array_size));
-    }
-    // First create the new person
-    struct Person *person = calloc(1, sizeof(struct Person));
-    person->name = strdup(name); // strdup itself allocates the memory so no need to do it
-    person->location = strdup("NOWHERE");
-    person->item_count = 0;
-    person->item_array_size = INITIAL_ARRAY_SIZE;
-    person->items = calloc(INITIAL_ARRAY_SIZE, sizeof(char*));
-    person->amounts = calloc(INITIAL_ARRAY_SIZE, sizeof(int));
-    // Then add it to the end of the "people" array
-    (*people)[*people_count - 1] = person;
-}
-
-// Adds a new item to a Person
-void addItem(struct Person *person, char *item_name, int amount){
-    person->item_count++; // Update the number of items
-    if (person->item_count == person->item_array_size){ // If array is almost full reallocate it
-        person->item_array_size *= 2;
-        person->items = realloc(person->items, sizeof(char*) * (person->item_array_size));
-        person->amounts = realloc(person->amounts, sizeof(int) * (person->item_array_size));
+    return -1;
+}
+
+// Doubles the hash table of a column and reinserts every row
+void growColumnSlots(struct Item_Column *column){
+    int slot_count = column->slot_count * 2;
+    int *slots = allocateSlots(slot_count);
+    for (int row = 0; row < column->row_count; ++row) {
+        insertSlot(slots, slot_count, hashId(column->handles[row]), row);
     }
-    // Add the item
-    person->items[person->item_count - 1] = malloc(strlen(item_name) + 1); // Allocate the memory for the item name
-    strcpy(person->items[person->item_count - 1], item_name); // Add the name to allocated address
-    person->amounts[person->item_count - 1] = amount; // amount is integer no need to allocate
+    retireShared(column->slots);
+    PUBLISH(column->slots, slots);
+    PUBLISH(column->slot_count, slot_count);
 }
 
-// prints out all the people in a specific location
-void who_at(struct Person **people, char *location, int people_count){
-    bool found = false;
-    for (int i = 0; i < people_count; i++){
-        if (strcmp(people[i]->location, location) == 0){
-            if(!found){
-                printf("%s", people[i]->name);
-                fflush(stdout);
-                found = true;
-            }
-            else{
-                printf("%s", " and ");
-                printf("%s", people[i]->name);
-                fflush(stdout);
+// Numbers a location the first time a plan goes to it, the column of every item has a place total for each numbered location
+void reservePlace(struct Person_Registry *registry, int location){
+    if (location < registry->places_array_size && registry->places[location] != -1){
+        return;
+    }
+    beginWrite();
+    if (location >= registry->places_array_size){ // enough for every interned string like the residents array
+        int old_size = registry->places_array_size;
+        int size = symbol_table->array_size;
+        int *grown = growShared(registry->places, sizeof(int) * old_size, sizeof(int) * size);
+        memset(&grown[old_size], -1, sizeof(int) * (size - old_size));
+        PUBLISH(registry->places, grown);
+        PUBLISH(registry->places_array_size, size);
+    }
+    if (registry->place_count == registry->place_array_size){ // If the place totals are full reallocate them
+        int old_size = registry->place_array_size;
+        registry->place_array_size *= 2;
+        for (int item = 0; item < registry->column_array_size; ++item) {
+            struct Item_Column *column = registry->columns[item];
+            if (column != NULL){
+                long long *grown = growShared(column->place_totals, sizeof(long long) * old_size, sizeof(long long) * registry->place_array_size);
+                memset(&grown[old_size], 0, sizeof(long long) * (registry->place_array_size - old_size));
+                PUBLISH(column->place_totals, grown);
             }
         }
     }
-    if (!found){ // if no one is found
-        printf("%s", "NOBODY");
-        fflush(stdout);
+    // the place totals hold the place before a reader can find its number
+    PUBLISH(registry->places[location], registry->place_count++);
+    endWrite();
+}
+
+// Adds amount to an item in the inventory of a person (or takes it away if it is negative), index is the index of the item
+// The row of the person in the column of the item and the totals of the item change with it
+void changeAmount(struct Person_Registry *registry, int person, int index, int amount){
+    struct Inventory *inventory = &registry->inventories[person];
+    struct Item_Column *column = registry->columns[inventory->items[index]];
+    PUBLISH(inventory->amounts[index], inventory->amounts[index] + amount);
+    column->amounts[inventory->rows[index]] += amount; // only the person's own statement writes its row
+    addTotal(&column->total, amount);
+    int location = registry->locations[person];
+    if (location != NOWHERE_SYMBOL){ // people at NOWHERE are only counted in the total of everyone
+        addTotal(&column->place_totals[registry->places[location]], amount);
     }
-    printf("%s", "\n");
-    fflush(stdout);
 }
 
-// returns how many item the person has
-int getItemNumber(struct Person *person, char *item_name){
-    int index = getItemIndex(person,item_name);
-    if( index == -1 ){
-        return 0;
+// Adds to a total, in a parallel batch people that are changed by the same level may have the same item or be at the same place
+void addTotal(long long *total, int amount){
+    if (shared_totals){
+        __atomic_fetch_add(total, amount, __ATOMIC_RELAXED);
+    }
+    else{
+        __atomic_store_n(total, *total + amount, __ATOMIC_RELAXED); // only the writer changes it but readers load it
     }
-    return person->amounts[index];
 }
 
-// returns the index of an item in the item array of a person
-int getItemIndex(struct Person *person, char *item_name){
-    for (int i = 0; i < person->item_count; ++i) {
-        if(strcmp(person->items[i], item_name) == 0){
-            return i;
-        }
+// returns the sum of the first count amounts of a column, eight (AVX2) or four (SSE2) of them at a time
+// Every amount is widened to 64 bits before it is added, the sum of a column may not fit in an int
+long long sumColumn(int *amounts, int count){
+    int i = 0;
+    long long total = 0;
+#ifdef __SSE2__
+    __m128i sums = _mm_setzero_si128(); // two 64-bit lanes
+#ifdef __AVX2__
+    __m256i wide_sums = _mm256_setzero_si256(); // four 64-bit lanes
+    for (; i + 8 <= count; i += 8) {
+        wide_sums = _mm256_add_epi64(wide_sums, _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i *) &amounts[i])));
+        wide_sums = _mm256_add_epi64(wide_sums, _mm256_cvtepi32_epi64(_mm_loadu_si128((__m128i *) &amounts[i + 4])));
     }
-    return -1;
+    sums = _mm_add_epi64(_mm256_castsi256_si128(wide_sums), _mm256_extracti128_si256(wide_sums, 1));
+#endif
+    for (; i + 4 <= count; i += 4) {
+        __m128i values = _mm_loadu_si128((__m128i *) &amounts[i]);
+        __m128i signs = _mm_srai_epi32(values, 31); // SSE2 has no widening load, the amounts are interleaved with their signs
+        sums = _mm_add_epi64(sums, _mm_unpacklo_epi32(values, signs));
+        sums = _mm_add_epi64(sums, _mm_unpackhi_epi32(values, signs));
+    }
+    long long lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, sums);
+    total = lanes[0] + lanes[1];
+#endif
+    for (; i < count; ++i) {
+        total += amounts[i];
+    }
+    return total;
 }
 
 
 
 // Processes a condition sequence and returns its value
 // It calls a primitive condition function which controls a condition for only one subject and one subject
-bool checkConditionSequence(struct Condition_Sequence *sequence, struct Person ***people, int *people_count, int *people_array_size) {
+// Each subject is used once per condition, not once per object, and the first false condition stops the sequence
+bool checkConditionSequence(struct Plan_Sequence *sequence, struct Person_Registry *registry) {
     for (int i = 0; i < sequence->condition_count; ++i) {
         // For each condition
-        struct Condition *condition = sequence->conditions[i];
+        struct Plan_Condition *condition = &sequence->conditions[i];
         for (int j = 0; j < condition->num_of_subjects; ++j) {
             // Every subject has to satisfy the condition for every object
-            struct Person *subject = findPerson(people, condition->subjects[j], people_count, people_array_size);
+            int subject = usePerson(registry, condition->subjects[j]);
             for (int k = 0; k < condition->num_of_objects; ++k) {
-                bool result = primitiveCondition(subject, condition->mode, condition->objects[k], condition->amounts[k]);
+                bool result = primitiveCondition(registry, subject, condition->mode, condition->objects[k], condition->amounts[k]);
                 if (!result) {
                     return false;
                 }
@@ -1693,172 +3901,329 @@ bool checkConditionSequence(struct Condition_Sequence *sequence, struct Person *
     return true;
 }
 
-bool primitiveCondition(struct Person *person, char *mode, char* object, int count){
-    if (strcmp(mode, "at") == 0){
-        if (strcmp(person -> location, object) == 0){
-            return true;
-        }
-        return false;
+bool primitiveCondition(struct Person_Registry *registry, int person, enum Condition_Mode mode, int object, int count){
+    switch (mode) {
+    case CONDITION_AT:
+        return registry->locations[person] == object;
+    case CONDITION_HAS:
+        return getItemNumber(&registry->inventories[person], object) == count;
+    case CONDITION_HAS_MORE:
+        return getItemNumber(&registry->inventories[person], object) > count;
+    case CONDITION_HAS_LESS:
+        return getItemNumber(&registry->inventories[person], object) < count;
     }
+    return false;
+}
 
-    if (strcmp(mode, "has") == 0){
-        if (getItemNumber(person, object) == count){
-            return true;
+// Constructor of the output, responses are written to fd
+struct Output *initializeOutput(int fd, enum Flush_Mode mode){
+    struct Output *new_output = calloc(1, sizeof(struct Output));
+    new_output->fd = fd;
+    new_output->mode = mode;
+    new_output->length = 0;
+    new_output->capacity = mode == FLUSH_CAPTURE ? CAPTURE_BUFFER_SIZE : OUTPUT_BUFFER_SIZE;
+    new_output->buffer = malloc(new_output->capacity);
+    output = new_output;
+    return new_output;
+}
+
+// appends bytes to the output buffer, the buffer is written first if they do not fit
+// A captured output is never written, its buffer grows instead
+void writeBytes(char *bytes, size_t length){
+    if (output->mode == FLUSH_CAPTURE && output->length + length > output->capacity){
+        while (output->length + length > output->capacity){
+            output->capacity *= 2;
+        }
+        output->buffer = realloc(output->buffer, output->capacity);
+    }
+    if (output->length + length > output->capacity){
+        flushOutput();
+        if (length > output->capacity){ // too big to be buffered at all
+            writeAll(output->fd, bytes, length);
+            return;
         }
-        return false;
     }
+    memcpy(output->buffer + output->length, bytes, length);
+    output->length += length;
+}
 
-    if (strcmp(mode, "has more") == 0){
-        if (getItemNumber(person, object) > count){
-            return true;
+void writeString(char *str){
+    writeBytes(str, strlen(str));
+}
+
+void writeNumber(int number){
+    char digits[16];
+    int length = snprintf(digits, sizeof(digits), "%d", number);
+    writeBytes(digits, length);
+}
+
+void writeLongNumber(long long number){
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%lld", number);
+    writeBytes(digits, length);
+}
+
+// ends a response with a new line, it is written immediately if the output is flushed per line
+void endResponse(){
+    writeBytes("\n", 1);
+    if (output->mode == FLUSH_PER_LINE){
+        flushOutput();
+    }
+}
+
+// writes the whole buffer to the output file
+// With a journal the pending statements are committed first, so no response is seen before its statement is on the disk
+void flushOutput(){
+    if (journal != NULL && output->length > 0 && output->mode != FLUSH_CAPTURE){
+        commitJournal(journal);
+    }
+    writeAll(output->fd, output->buffer, output->length);
+    output->length = 0;
+}
+
+// writes bytes to a file descriptor, retrying until everything is written
+// returns false if not every byte could be written
+bool writeAll(int fd, char *bytes, size_t length){
+    size_t written = 0;
+    while (written < length){
+        ssize_t count = write(fd, bytes + written, length - written);
+        if (count <= 0){ // the output is closed, the bytes are dropped
+            return false;
         }
-        return false;
+        written += count;
     }
+    return true;
+}
 
-    if (strcmp(mode, "has less") == 0){
-        if (getItemNumber(person, object) < count){
-            return true;
+// Syncs the directory of a path so that a file renamed into it stays renamed after a crash, returns false if it could not be synced
+bool syncDirectory(char *path){
+    char *slash = strrchr(path, '/');
+    char *directory = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : slash - path);
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    bool synced = fd != -1 && fsync(fd) == 0;
+    if (fd != -1){
+        close(fd);
+    }
+    free(directory);
+    return synced;
+}
+
+// Processes the action sequences of a plan whose condition sequences are true
+// Every change is recorded in an undo log that lives until the end of the statement. The statement is a savepoint of the log
+// and each action is a savepoint inside it: an action that fails is taken back to its own savepoint, and with --atomic
+// the statement is taken back to its savepoint too so none of its actions happen
+void executePlan(struct Plan *plan, struct Person_Registry *registry){
+    beginWrite();
+    struct Undo_Log log;
+    log.entries = arenaAlloc(plan->undo_size * sizeof(struct Undo_Entry));
+    log.entry_count = 0;
+    int statement = log.entry_count;
+    for (int i = 0; i < plan->sequence_count; ++i) { //For each sequence
+        struct Plan_Sequence *sequence = &plan->sequences[i];
+        bool done = true;
+        // the last action sequence may not have a condition sequence
+        if (sequence->condition_count == 0){
+            done = processActionSequence(sequence, registry, &log);
+        }
+        else{
+            // if condition sequence is true process the action sequence
+            BENCHMARK_START(condition_start);
+            bool result = checkConditionSequence(sequence, registry);
+            BENCHMARK_RECORD(PHASE_CONDITIONS, condition_start);
+            if (result){
+                done = processActionSequence(sequence, registry, &log);
+            }
+        }
+        if (!done && atomic_statements){
+            rollback(registry, &log, statement);
+            break;
         }
-        return false;
     }
-    return false;
+    endWrite();
 }
 
-// Processes each action in an action sequence
-void processActionSequence(struct Action_Sequence sequence, struct Person ***people, int *people_count, int *people_array_size){
-    for (int i = 0; i < sequence.action_count; ++i) {
-        processAction(*sequence.actions[i],people,people_count,people_array_size);
+// Processes each action in an action sequence, returns false if an action failed
+// With --atomic the rest of the sequence is not processed after an action failed since the statement is taken back
+bool processActionSequence(struct Plan_Sequence *sequence, struct Person_Registry *registry, struct Undo_Log *log){
+    bool done = true;
+    for (int i = 0; i < sequence->action_count && (done || !atomic_statements); ++i) {
+        BENCHMARK_START(action_start);
+        done = processAction(&sequence->actions[i], registry, log) && done;
+        BENCHMARK_RECORD(PHASE_ACTIONS, action_start);
     }
+    return done;
 }
-// Primitive action can not process sell to and buy from methods.
-// Instead of processing there we decided to use primitive condition to check prerequisites and if it is true process with primitive actions
+// Sell, sell to and buy from happen only if every seller has enough of every item. They are executed in a single pass:
+// the sells are made one by one and recorded in the undo log, the first seller that does not have enough takes the action
+// back to its savepoint. Buys come after every sell of the action so a failed action never buys anything
 // For example a buy 4 bread from b is equivalent with: a buy 4 bread and b sell 4 bread unless b has less than 4 bread
-void processAction(struct Action action, struct Person ***people, int *people_count, int *people_array_size) {
-    if (strcmp(action.mode, "go to") == 0) {
-        for (int i = 0; i < action.num_of_subjects; ++i) {
-            // Find the person
-            struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
+// returns false if the action failed and changed nothing
+bool processAction(struct Plan_Action *action, struct Person_Registry *registry, struct Undo_Log *log) {
+    int savepoint = log->entry_count;
+    switch (action->mode) {
+    case ACTION_GO_TO:
+        for (int i = 0; i < action->num_of_subjects; ++i) {
+            // Subjects are handles already, using one only gives it a rank the first time
+            int person = usePerson(registry, action->subjects[i]);
             // Process it
-            primitiveAction(person, action.mode, 1, action.objects[0]);
+            primitiveAction(registry, log, person, action->mode, 1, action->objects[0]);
         }
-    }
-    if (strcmp(action.mode, "buy") == 0) {
-        for (int i = 0; i < action.num_of_subjects; ++i) {
-            struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
-            for (int j = 0; j < action.num_of_objects; ++j) {
-                primitiveAction(person, action.mode, action.amounts[j], action.objects[j]);
+        break;
+
+    case ACTION_BUY:
+        for (int i = 0; i < action->num_of_subjects; ++i) {
+            int person = usePerson(registry, action->subjects[i]);
+            for (int j = 0; j < action->num_of_objects; ++j) {
+                primitiveAction(registry, log, person, action->mode, action->amounts[j], action->objects[j]);
             }
         }
-    }
-
-    if (strcmp(action.mode, "buy from") == 0) {
-        struct Person *trader = findPerson(people, action.trader, people_count, people_array_size);
-        for (int j = 0; j < action.num_of_objects; ++j) {
-            // For each object
-            int total = action.num_of_subjects * action.amounts[j];
-            // Check whether trader has enough of them or not
-            if (primitiveCondition(trader, "has less", action.objects[j], total)) {
-                // If he does not have enough item return
-                return;
+        break;
+
+    case ACTION_BUY_FROM: {
+        int trader = usePerson(registry, action->trader);
+        for (int j = 0; j < action->num_of_objects; ++j) {
+            // Trader sells what every subject buys unless he does not have enough of an item, nobody has more than INT_MAX
+            if (!sellItem(registry, log, trader, action->objects[j], (long long) action->num_of_subjects * action->amounts[j])) {
+                rollback(registry, log, savepoint);
+                return false;
             }
         }
-        //If he has enough item
-        for (int j = 0; j < action.num_of_objects; ++j) {
-            int total = action.num_of_subjects * action.amounts[j];
-            // Trader sells his items
-            primitiveAction(trader, "sell", total, action.objects[j]);
-            for (int i = 0; i < action.num_of_subjects; ++i) {
-                // Subjects buy
-                struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
-                primitiveAction(person, "buy", action.amounts[j], action.objects[j]);
+        for (int i = 0; i < action->num_of_subjects; ++i) {
+            // Subjects buy, each of them gets every item in the order of the objects
+            int person = usePerson(registry, action->subjects[i]);
+            for (int j = 0; j < action->num_of_objects; ++j) {
+                primitiveAction(registry, log, person, ACTION_BUY, action->amounts[j], action->objects[j]);
             }
         }
+        break;
     }
 
-    if (strcmp(action.mode, "sell") == 0) {
-        for (int i = 0; i < action.num_of_subjects; ++i) { // First check whether each subject has enough item or not
-            struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
-            for (int j = 0; j < action.num_of_objects; ++j) {
-                if (primitiveCondition(person, "has less", action.objects[j], action.amounts[j])) {
-                    // If someone does not have enough return
-                    return;
-                }
-            }
-        }
-        for (int i = 0; i < action.num_of_subjects; ++i) { // If they have enough items then make them sell
-            struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
-            for (int j = 0; j < action.num_of_objects; ++j) {
-                primitiveAction(person, action.mode, action.amounts[j], action.objects[j]);
+    case ACTION_SELL:
+    case ACTION_SELL_TO: {
+        int trader = action->mode == ACTION_SELL_TO ? usePerson(registry, action->trader) : -1;
+        for (int j = 0; trader != -1 && j < action->num_of_objects; ++j) { // the trader cannot buy more than INT_MAX at once
+            if ((long long) action->num_of_subjects * action->amounts[j] > INT_MAX){
+                return false;
             }
         }
-    }
-    if (strcmp(action.mode, "sell to") == 0) {
-        struct Person *trader = findPerson(people, action.trader, people_count, people_array_size);
-        for (int i = 0; i < action.num_of_subjects; ++i) { // Similar to sell check
-            struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
-            for (int j = 0; j < action.num_of_objects; ++j) {
-                if (primitiveCondition(person, "has less", action.objects[j], action.amounts[j])) {
-                    return;
+        for (int i = 0; i < action->num_of_subjects; ++i) { // Every subject sells every item
+            int person = usePerson(registry, action->subjects[i]);
+            for (int j = 0; j < action->num_of_objects; ++j) {
+                if (!sellItem(registry, log, person, action->objects[j], action->amounts[j])) {
+                    // If someone does not have enough nobody sells
+                    rollback(registry, log, savepoint);
+                    return false;
                 }
             }
         }
-        for (int j = 0; j < action.num_of_objects; ++j) { // Similar to sell the only difference trader buys those items
-            int total = action.num_of_subjects * action.amounts[j];
-            primitiveAction(trader, "buy", total, action.objects[j]);
-            for (int i = 0; i < action.num_of_subjects; ++i) {
-                struct Person *person = findPerson(people, action.subjects[i], people_count, people_array_size);
-                primitiveAction(person, "sell", action.amounts[j], action.objects[j]);
-            }
+        for (int j = 0; trader != -1 && j < action->num_of_objects; ++j) { // the trader of sell to buys what the subjects sold
+            primitiveAction(registry, log, trader, ACTION_BUY, action->num_of_subjects * action->amounts[j], action->objects[j]);
         }
+        break;
+    }
     }
+    return true;
 }
-// Handles sell, go to and buy
-void primitiveAction(struct Person *person, char *mode, int num, char *object){
-    if(strcmp(mode,"go to") == 0){
-        person->location = strdup(object);
+
+// Sells an amount of an item from a person and records it in the undo log
+// returns false and changes nothing if the person has less than the amount, which may be more than an int holds
+bool sellItem(struct Person_Registry *registry, struct Undo_Log *log, int person, int item, long long amount){
+    struct Inventory *inventory = &registry->inventories[person];
+    int index = getItemIndex(inventory, item);
+    if (index == -1){ // nobody can sell something they never had, unless the amount is 0
+        return amount <= 0;
     }
-    else if(strcmp(mode,"buy") == 0){
-        int index = getItemIndex(person,object);
-        if (index == -1){
-            addItem(person,object,num);
-        }
-        else{
-            person->amounts[index] += num;
-        }
+    if (inventory->amounts[index] < amount){
+        return false;
     }
-    else if(strcmp(mode,"sell") == 0){
-        int index = getItemIndex(person,object);
-        if (index == -1 ){return;}
-        if (person->amounts[index] >= num){
-            person->amounts[index] -= num;
-            return;
+    changeAmount(registry, person, index, -amount);
+    struct Undo_Entry *entry = logChange(log, UNDO_AMOUNT, person);
+    entry->index = index;
+    entry->amount = -amount;
+    return true;
+}
+
+// returns the next entry of the undo log after filling its kind and person
+struct Undo_Entry *logChange(struct Undo_Log *log, enum Undo_Kind kind, int person){
+    struct Undo_Entry *entry = &log->entries[log->entry_count++];
+    entry->kind = kind;
+    entry->person = person;
+    return entry;
+}
+
+// Takes back every change of the undo log after a savepoint, the newest first
+// A new item is always the last item of its inventory when it is taken back because the changes after it were taken back before
+void rollback(struct Person_Registry *registry, struct Undo_Log *log, int savepoint){
+    while (log->entry_count > savepoint){
+        struct Undo_Entry *entry = &log->entries[--log->entry_count];
+        switch (entry->kind) {
+        case UNDO_AMOUNT:
+            changeAmount(registry, entry->person, entry->index, -entry->amount);
+            break;
+        case UNDO_NEW_ITEM: // its amount is 0 again, the row of the person in the column stays reserved
+            removeLastItem(&registry->inventories[entry->person]);
+            break;
+        case UNDO_MOVE:
+            movePerson(registry, entry->person, entry->location);
+            break;
         }
     }
 }
 
+// Handles go to and buy and records them in the undo log
+void primitiveAction(struct Person_Registry *registry, struct Undo_Log *log, int person, enum Action_Mode mode, int num, int object){
+    struct Inventory *inventory = &registry->inventories[person];
+    struct Undo_Entry *entry;
+    int index;
+    switch (mode) {
+    case ACTION_GO_TO:
+        if (registry->locations[person] != object){
+            entry = logChange(log, UNDO_MOVE, person);
+            entry->location = registry->locations[person];
+            movePerson(registry, person, object);
+        }
+        break;
+    case ACTION_BUY:
+        index = getItemIndex(inventory, object);
+        if (index == -1){
+            // the row of the person in the column of the item was reserved before the plan was executed, see reservePlanRows
+            addItem(inventory, object, 0, findRow(registry->columns[object], person));
+            index = inventory->item_count - 1;
+            logChange(log, UNDO_NEW_ITEM, person);
+        }
+        changeAmount(registry, person, index, num);
+        entry = logChange(log, UNDO_AMOUNT, person);
+        entry->index = index;
+        entry->amount = num;
+        break;
+    default: // sells can fail so processAction makes them with sellItem
+        break;
+    }
+}
 
-// Constructor of an action
+// Constructor of an action, the action lives in the arena until the end of the statement
 struct Action *initializeAction(){
-    struct Action *action = calloc(1,sizeof (struct Action));
+    struct Action *action = arenaAlloc(sizeof (struct Action));
     action->num_of_objects = 0;
     action->num_of_subjects = 0;
     action->subj_array_size = INITIAL_ARRAY_SIZE;
     action->obj_array_size = INITIAL_ARRAY_SIZE;
-    action->subjects = calloc(action->subj_array_size, sizeof(char*));
-    action->objects = calloc(action->obj_array_size, sizeof(char*));
-    action->amounts = calloc(action->obj_array_size, sizeof(int));
+    action->subjects = arenaAlloc(action->subj_array_size * sizeof(int));
+    action->objects = arenaAlloc(action->obj_array_size * sizeof(int));
+    action->amounts = arenaAlloc(action->obj_array_size * sizeof(int));
+    action->trader = -1;
     return action;
 }
 // Constructor of condition
 struct Condition *initializeCondition(){
-    struct Condition *condition = calloc(1, sizeof(struct Condition));
+    struct Condition *condition = arenaAlloc(sizeof(struct Condition));
     condition->num_of_objects = 0;
     condition->num_of_subjects = 0;
     condition->subj_array_size = INITIAL_ARRAY_SIZE;
     condition->obj_array_size = INITIAL_ARRAY_SIZE;
-    condition->subjects = calloc(condition->subj_array_size, sizeof(char*));
-    condition->objects = calloc(condition->obj_array_size, sizeof(char*));
-    condition->amounts = calloc(condition->obj_array_size, sizeof(int));
+    condition->subjects = arenaAlloc(condition->subj_array_size * sizeof(int));
+    condition->objects = arenaAlloc(condition->obj_array_size * sizeof(int));
+    condition->amounts = arenaAlloc(condition->obj_array_size * sizeof(int));
     return condition;
 }
 
@@ -1867,10 +4232,9 @@ void actionAddSubject(struct Action *action, char *subject){
     action->num_of_subjects++;
     if (action->num_of_subjects == action->subj_array_size){
         action->subj_array_size *= 2;
-        action->subjects = realloc(action->subjects, action->subj_array_size * sizeof(char*));
+        action->subjects = arenaGrow(action->subjects, action->subj_array_size / 2 * sizeof(int), action->subj_array_size * sizeof(int));
     }
-    action->subjects[action->num_of_subjects - 1] = calloc(1, sizeof(char*));
-    action->subjects[action->num_of_subjects - 1] = strdup(subject);
+    action->subjects[action->num_of_subjects - 1] = internString(subject);
 
 }
 // Adds an object to an action
@@ -1878,254 +4242,414 @@ void actionAddObject(struct Action *action, char *object, int amount){
     action->num_of_objects++;
     if (action->num_of_objects == action->obj_array_size){
         action->obj_array_size *= 2;
-        action->objects = realloc(action->objects, action->obj_array_size * sizeof(char*));
-        action->amounts = realloc(action->amounts, action->obj_array_size * sizeof(int));
+        action->objects = arenaGrow(action->objects, action->obj_array_size / 2 * sizeof(int), action->obj_array_size * sizeof(int));
+        action->amounts = arenaGrow(action->amounts, action->obj_array_size / 2 * sizeof(int), action->obj_array_size * sizeof(int));
     }
-    action->objects[action->num_of_objects - 1] = calloc(1, sizeof(char*));
-    action->objects[action->num_of_objects - 1] = strdup(object);
+    action->objects[action->num_of_objects - 1] = internString(object);
     action->amounts[action->num_of_objects -1] = amount;
 }
 
-// Adds a subject to a condition
-void conditionAddSubject(struct Condition *condition, char *subject){
-    condition->num_of_subjects++;
-    if (condition->num_of_subjects == condition->subj_array_size){
-        condition->subj_array_size *= 2;
-        condition->subjects = realloc(condition->subjects, condition->subj_array_size * sizeof(char*));
-    }
-    condition->subjects[condition->num_of_subjects - 1] = calloc(1, sizeof(char*));
-    condition->subjects[condition->num_of_subjects - 1] = strdup(subject);
-}
 // Adds an object to a condition
 void conditionAddObject(struct Condition *condition, char *object, int amount){
     condition->num_of_objects++;
     if (condition->num_of_objects == condition->obj_array_size){
         condition->obj_array_size *= 2;
-        condition->objects = realloc(condition->objects, condition->obj_array_size * sizeof(char*));
-        condition->amounts = realloc(condition->amounts, condition->obj_array_size * sizeof(int));
+        condition->objects = arenaGrow(condition->objects, condition->obj_array_size / 2 * sizeof(int), condition->obj_array_size * sizeof(int));
+        condition->amounts = arenaGrow(condition->amounts, condition->obj_array_size / 2 * sizeof(int), condition->obj_array_size * sizeof(int));
     }
-    condition->objects[condition->num_of_objects - 1] = calloc(1, sizeof(char*));
-    condition->objects[condition->num_of_objects - 1] = strdup(object);
+    condition->objects[condition->num_of_objects - 1] = internString(object);
     condition->amounts[condition->num_of_objects -1] = amount;
 }
 
 // Constructor of an action sequence
 struct Action_Sequence *initializeActionSequence(){
-    struct Action_Sequence *sequence = calloc(1,sizeof (struct Action_Sequence));
+    struct Action_Sequence *sequence = arenaAlloc(sizeof (struct Action_Sequence));
     sequence->action_array_size = INITIAL_ARRAY_SIZE;
     sequence->action_count = 0;
-    sequence->actions = calloc(sequence->action_array_size, sizeof(struct Action*));
+    sequence->actions = arenaAlloc(sequence->action_array_size * sizeof(struct Action*));
     return sequence;
 }
 // Constructor of a condition sequence
 struct Condition_Sequence *initializeConditionSequence(){
-    struct Condition_Sequence *sequence = calloc(1,sizeof(struct Condition_Sequence));
+    struct Condition_Sequence *sequence = arenaAlloc(sizeof(struct Condition_Sequence));
     sequence->condition_array_size = INITIAL_ARRAY_SIZE;
     sequence->condition_count = 0;
-    sequence->conditions = calloc(sequence->condition_array_size, sizeof(struct Condition*));
+    sequence->conditions = arenaAlloc(sequence->condition_array_size * sizeof(struct Condition*));
     return sequence;
 }
 
+// Constructor of a sentence
+struct Sentence *initializeSentence(){
+    struct Sentence *sentence = arenaAlloc(sizeof(struct Sentence));
+    sentence->action_sequence_count = 0;
+    sentence->condition_sequence_count = 0;
+    sentence->action_array_size = INITIAL_ARRAY_SIZE;
+    sentence->condition_array_size = INITIAL_ARRAY_SIZE;
+    sentence->action_sequences = arenaAlloc(sentence->action_array_size * sizeof(struct Action_Sequence*));
+    sentence->condition_sequences = arenaAlloc(sentence->condition_array_size * sizeof(struct Condition_Sequence*));
+    return sentence;
+}
+
 // Adds an action to an action sequence
-void sequenceAddAction(struct Action_Sequence *sequence, struct Action action){
-    struct Action *copy  = calloc(1, sizeof(struct Action));
+void sequenceAddAction(struct Action_Sequence *sequence, struct Action *action){
     sequence->action_count += 1;
     if (sequence->action_count == sequence->action_array_size){
         sequence->action_array_size *= 2;
-        sequence->actions = realloc(sequence->actions, sequence->action_array_size * sizeof(struct Action*));
-    }
-    copy->num_of_subjects = action.num_of_subjects;
-    copy->num_of_objects = action.num_of_objects;
-    copy->subj_array_size= action.subj_array_size;
-    copy->obj_array_size = action.obj_array_size;
-    copy->subjects = calloc(copy->subj_array_size, sizeof(char*));
-    copy->objects = calloc(copy->obj_array_size, sizeof(char*));
-    copy->amounts = calloc(copy->obj_array_size, sizeof(int));
-    copy->mode = strdup(action.mode);
-    if (action.trader != NULL){
-        copy->trader = strdup(action.trader);
-    }
-    for (int i = 0; i < copy->num_of_subjects; ++i) {
-        copy->subjects[i] = strdup(action.subjects[i]);
-    }
-    for (int i = 0; i < copy->num_of_objects; ++i) {
-        copy->objects[i] = strdup(action.objects[i]);
-        copy->amounts = action.amounts;
+        sequence->actions = arenaGrow(sequence->actions, sequence->action_array_size / 2 * sizeof(struct Action*), sequence->action_array_size * sizeof(struct Action*));
     }
-
-    sequence->actions[sequence->action_count - 1] = copy;
+    sequence->actions[sequence->action_count - 1] = action;
 }
 // Adds a condition to a condition sequence
-void sequenceAddCondition(struct Condition_Sequence *sequence, struct Condition condition){
-    struct Condition *copy  = calloc(1, sizeof(struct Condition));
+void sequenceAddCondition(struct Condition_Sequence *sequence, struct Condition *condition){
     sequence->condition_count += 1;
     if (sequence->condition_count == sequence->condition_array_size){
         sequence->condition_array_size *= 2;
-        sequence->conditions = realloc(sequence->conditions, sequence->condition_array_size * sizeof(struct Condition*));
-    }
-    copy->num_of_subjects = condition.num_of_subjects;
-    copy->num_of_objects = condition.num_of_objects;
-    copy->subj_array_size= condition.subj_array_size;
-    copy->obj_array_size = condition.obj_array_size;
-    copy->subjects = calloc(copy->subj_array_size, sizeof(char*));
-    copy->objects = calloc(copy->obj_array_size, sizeof(char*));
-    copy->amounts = calloc(copy->obj_array_size, sizeof(int));
-    copy->mode = strdup(condition.mode);
-    for (int i = 0; i < copy->num_of_subjects; ++i) {
-        copy->subjects[i] = strdup(condition.subjects[i]);
-    }
-    for (int i = 0; i < copy->num_of_objects; ++i) {
-        copy->objects[i] = strdup(condition.objects[i]);
-        copy->amounts = condition.amounts;
-    }
-
-    sequence->conditions[sequence->condition_count - 1] = copy;
-}
-
-// Adds an action sequence to an action sequence array
-void addActionSequence(struct Action_Sequence ***array, struct Action_Sequence *sequence, int *array_size, int *num_elements){
-    *num_elements += 1;
-    if (*num_elements == *array_size){
-        *array_size *= 2;
-        *array = realloc(*array,(*array_size) * sizeof(struct Action_Sequence*));
-    }
-    (*array)[*num_elements - 1] = calloc(1,sizeof(struct Action_Sequence));
-    struct Action_Sequence *copy = calloc(1,sizeof (struct Action_Sequence));
-    copy->action_count = sequence->action_count;
-    copy->action_array_size = sequence->action_array_size;
-    copy->actions = calloc(copy->action_array_size, sizeof(struct Action*));
-    for (int i = 0; i < copy->action_count; ++i) {
-        copy->actions[i] = calloc(1,sizeof (struct Action));
-        *copy->actions[i] = *sequence->actions[i];
-    }
-    (*array)[*num_elements - 1] = copy;
-
-}
-// Adds a condition sequence to a condition sequence array
-void addConditionSequence(struct Condition_Sequence ***array, struct Condition_Sequence *sequence, int *array_size, int *num_elements){
-    *num_elements += 1;
-    if (*num_elements == *array_size){
-        *array_size *= 2;
-        *array = realloc(*array,(*array_size) * sizeof(struct Condition_Sequence*));
-    }
-    (*array)[*num_elements - 1] = calloc(1,sizeof(struct Condition_Sequence));
-    struct Condition_Sequence *copy = calloc(1,sizeof (struct Condition_Sequence));
-    copy->condition_count = sequence->condition_count;
-    copy->condition_array_size = sequence->condition_array_size;
-    copy->conditions = calloc(copy->condition_array_size, sizeof(struct Condition*));
-    for (int i = 0; i < copy->condition_count; ++i) {
-        copy->conditions[i] = calloc(1,sizeof (struct Condition));
-        *copy->conditions[i] = *sequence->conditions[i];
-    }
-    (*array)[*num_elements - 1] = copy;
-}
-
-// frees the allocated memory for a person struct pointer and its contents
-void freePerson(struct Person *person) {
-    if (person == NULL) {
+        sequence->conditions = arenaGrow(sequence->conditions, sequence->condition_array_size / 2 * sizeof(struct Condition*), sequence->condition_array_size * sizeof(struct Condition*));
+    }
+    sequence->conditions[sequence->condition_count - 1] = condition;
+}
+
+// Adds an action sequence to a sentence
+void addActionSequence(struct Sentence *sentence, struct Action_Sequence *sequence){
+    sentence->action_sequence_count += 1;
+    if (sentence->action_sequence_count == sentence->action_array_size){
+        sentence->action_array_size *= 2;
+        sentence->action_sequences = arenaGrow(sentence->action_sequences, sentence->action_array_size / 2 * sizeof(struct Action_Sequence*), sentence->action_array_size * sizeof(struct Action_Sequence*));
+    }
+    sentence->action_sequences[sentence->action_sequence_count - 1] = sequence;
+}
+// Adds a condition sequence to a sentence
+void addConditionSequence(struct Sentence *sentence, struct Condition_Sequence *sequence){
+    sentence->condition_sequence_count += 1;
+    if (sentence->condition_sequence_count == sentence->condition_array_size){
+        sentence->condition_array_size *= 2;
+        sentence->condition_sequences = arenaGrow(sentence->condition_sequences, sentence->condition_array_size / 2 * sizeof(struct Condition_Sequence*), sentence->condition_array_size * sizeof(struct Condition_Sequence*));
+    }
+    sentence->condition_sequences[sentence->condition_sequence_count - 1] = sequence;
+}
+
+// frees the arrays of an inventory, the inventory itself lives in the registry
+void freeInventory(struct Inventory *inventory) {
+    if (inventory == NULL) {
         return;
     }
 
-    // free each item string and the items array itself
-    if (person->items != NULL) {
-        for (int i = 0; i < person->item_count; i++) {
-            free(person->items[i]);
-        }
-        free(person->items);
+    // free the items array, item names belong to the symbol table
+    free(inventory->items);
+
+    // free the amounts array and the item hash table
+    free(inventory->amounts);
+    free(inventory->rows);
+    free(inventory->item_slots);
+}
+
+// frees the allocated memory for the column of an item
+void freeColumn(struct Item_Column *column) {
+    if (column == NULL) {
+        return;
     }
 
-    // free the amounts array
-    free(person->amounts);
+    free(column->handles);
+    free(column->amounts);
+    free(column->slots);
+    free(column->place_totals);
 
-    free(person);
+    free(column);
 }
 
-// frees the allocated memory for an action struct pointer and its contents
-void freeAction(struct Action *action) {
-    if (action == NULL) {
+// frees the allocated memory for the person registry and every person in it
+void freeRegistry(struct Person_Registry *registry) {
+    if (registry == NULL) {
         return;
     }
 
-    // free each subject string and the subjects array itself
-    if (action->subjects != NULL) {
-        for (int i = 0; i < action->num_of_subjects; i++) {
-            free(action->subjects[i]);
-        }
-        free(action->subjects);
+    for (int i = 0; i < registry->people_count; i++) {
+        freeInventory(&registry->inventories[i]);
+    }
+    free(registry->names);
+    free(registry->ranks);
+    free(registry->locations);
+    free(registry->inventories);
+    for (int i = 0; i < registry->column_array_size; i++) {
+        freeColumn(registry->columns[i]);
     }
+    free(registry->columns);
+    free(registry->places);
+    free(registry->slots);
+    for (int i = 0; i < registry->residents_array_size; i++) {
+        free(registry->residents[i].handles);
+    }
+    free(registry->residents);
 
-    // free each object string and the objects array itself
-    if (action->objects != NULL) {
-        for (int i = 0; i < action->num_of_objects; i++) {
-            free(action->objects[i]);
-        }
-        free(action->objects);
+    free(registry);
+}
+
+// frees the allocated memory for the symbol table and every interned string
+void freeSymbolTable(struct Symbol_Table *table) {
+    if (table == NULL) {
+        return;
     }
 
-    // free the amounts array
-    free(action->amounts);
+    for (int i = 0; i < table->symbol_count; i++) {
+        free(table->strings[i]);
+    }
+    free(table->strings);
+    free(table->stamps);
+    free(table->slots);
 
-    free(action);
+    free(table);
 }
 
-// frees the allocated memory for a condition struct pointer and its contents
-void freeCondition(struct Condition *condition) {
-    if (condition == NULL) {
+// frees the allocated memory for the lexer, tokens point into the input line so they are not freed
+void freeLexer(struct Lexer *lexer) {
+    if (lexer == NULL) {
         return;
     }
 
-    // free each subject string and the subjects array itself
-    if (condition->subjects != NULL) {
-        for (int i = 0; i < condition->num_of_subjects; i++) {
-            free(condition->subjects[i]);
-        }
-        free(condition->subjects);
+    free(lexer->tokens);
+
+    free(lexer);
+}
+
+// frees every block of an arena
+void freeArena(struct Arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    struct Arena_Block *block = arena->first;
+    while (block != NULL) {
+        struct Arena_Block *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
+
+#ifdef BENCHMARK
+// returns a monotonic time in nanoseconds
+long long benchmarkClock(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Adds a latency to the samples of a phase
+void recordSample(struct Phase_Samples *phase, long long nanoseconds){
+    if (phase->count == phase->array_size){ // If array is full reallocate it
+        phase->array_size = phase->array_size == 0 ? INITIAL_SLOT_COUNT : phase->array_size * 2;
+        phase->samples = realloc(phase->samples, phase->array_size * sizeof(long long));
     }
+    phase->samples[phase->count++] = nanoseconds;
+}
 
-    // free each object string and the objects array itself
-    if (condition->objects != NULL) {
-        for (int i = 0; i < condition->num_of_objects; i++) {
-            free(condition->objects[i]);
+int compareSamples(const void *first, const void *second){
+    long long a = *(const long long *) first;
+    long long b = *(const long long *) second;
+    return (a > b) - (a < b);
+}
+
+// Prints the statement throughput and the latency percentiles of each phase to stderr
+void printBenchmark(long long elapsed){
+    double seconds = elapsed / 1e9;
+    fprintf(stderr, "statements: %lld in %.3f s, %.0f statements/sec\n", statement_count, seconds, statement_count / seconds);
+    fprintf(stderr, "%-14s %10s %12s %10s %10s %10s %10s\n", "phase", "count", "total ms", "p50 ns", "p90 ns", "p99 ns", "max ns");
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        struct Phase_Samples *phase = &phase_samples[i];
+        if (phase->count == 0){
+            fprintf(stderr, "%-14s %10d\n", phase_names[i], 0);
+            continue;
+        }
+        qsort(phase->samples, phase->count, sizeof(long long), compareSamples);
+        long long total = 0;
+        for (int j = 0; j < phase->count; ++j) {
+            total += phase->samples[j];
         }
-        free(condition->objects);
+        fprintf(stderr, "%-14s %10d %12.3f %10lld %10lld %10lld %10lld\n", phase_names[i], phase->count, total / 1e6,
+                phase->samples[phase->count / 2], phase->samples[(int) (phase->count * 0.9)],
+                phase->samples[(int) (phase->count * 0.99)], phase->samples[phase->count - 1]);
+        free(phase->samples);
+    }
+}
+#endif
+
+// frees the allocated memory for an input reader, the file is not closed
+void freeInputReader(struct Input_Reader *reader) {
+    if (reader == NULL) {
+        return;
     }
 
-    // free the amounts array
-    free(condition->amounts);
+    free(reader->buffer);
 
-    free(condition);
+    free(reader);
 }
 
-// frees the allocated memory for an action sequence struct pointer and its contents
-void freeActionSequence(struct Action_Sequence *sequence) {
-    if (sequence == NULL) {
+// writes the remaining responses and frees the output buffer
+void freeOutput(struct Output *output) {
+    if (output == NULL) {
         return;
     }
 
-    // free each action in the actions array and the actions array itself
-    if (sequence->actions != NULL) {
-        for (int i = 0; i < sequence->action_count; i++) {
-            freeAction(sequence->actions[i]);
-        }
-        free(sequence->actions);
+    flushOutput();
+    free(output->buffer);
+
+    free(output);
+}
+
+// frees the plan cache and every plan in it
+void freePlanCache(struct Plan_Cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    struct Plan *plan = cache->newest;
+    while (plan != NULL) {
+        struct Plan *older = plan->older;
+        free(plan);
+        plan = older;
+    }
+    free(cache->buckets);
+
+    free(cache);
+}
+
+// frees the allocated memory for a prepared statement and its plan
+void freePrepared(struct Prepared *prepared) {
+    if (prepared == NULL) {
+        return;
+    }
+
+    free(prepared->plan);
+    free(prepared->parameters);
+    free(prepared->amount_parameters);
+    free(prepared->sites);
+
+    free(prepared);
+}
+
+// frees the allocated memory for the table of prepared statements and every statement in it
+void freePreparedTable(struct Prepared_Table *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < table->statement_count; i++) {
+        freePrepared(table->statements[i]);
+    }
+    free(table->statements);
+    free(table->slots);
+
+    free(table);
+}
+
+// commits the pending statements and frees the allocated memory for the journal
+void freeJournal(struct Journal *journal) {
+    if (journal == NULL) {
+        return;
+    }
+
+    commitJournal(journal);
+    if (journal->fd != -1) {
+        close(journal->fd);
     }
+    free(journal->buffer);
+    free(journal->snapshot_path);
 
-    free(sequence);
+    free(journal);
 }
 
-// frees the allocated memory for a condition sequence struct pointer and its contents
-void freeConditionSequence(struct Condition_Sequence *sequence) {
-    if (sequence == NULL) {
+// stops the workers and frees the parallel executor, the window must be empty
+void freeParallel(struct Parallel *parallel) {
+    if (parallel == NULL) {
         return;
     }
 
-    // free each condition in the conditions array and the conditions array itself
-    if (sequence->conditions != NULL) {
-        for (int i = 0; i < sequence->condition_count; i++) {
-            freeCondition(sequence->conditions[i]);
+    parallel->stopping = true;
+    pthread_barrier_wait(&parallel->barrier);
+    for (int i = 0; i < parallel->thread_count - 1; ++i) {
+        pthread_join(parallel->workers[i], NULL);
+    }
+    pthread_barrier_destroy(&parallel->barrier);
+    for (int i = 0; i < parallel->window_size; ++i) {
+        free(parallel->tasks[i].question.tokens);
+        if (parallel->tasks[i].response != NULL) {
+            free(parallel->tasks[i].response->buffer);
+            free(parallel->tasks[i].response);
         }
-        free(sequence->conditions);
+    }
+    free(parallel->workers);
+    free(parallel->tasks);
+    free(parallel->order);
+    free(parallel->level_starts);
+    free(parallel->level_next);
+    free(parallel->read_levels);
+    free(parallel->write_levels);
+    free(parallel->stamps);
+
+    free(parallel);
+}
+
+// closes the socket of a connection and frees its buffers, responses that are not sent are dropped
+void freeConnection(struct Connection *connection) {
+    if (connection == NULL) {
+        return;
     }
 
-    free(sequence);
+    close(connection->fd);
+    freeInputReader(connection->reader);
+    free(connection->output->buffer);
+    free(connection->output);
+    if (connection->question != NULL) {
+        free(connection->question->text);
+        freeLexer(connection->question->lexer);
+        free(connection->question->response->buffer);
+        free(connection->question->response);
+        free(connection->question);
+    }
+
+    free(connection);
+}
+
+// closes every connection and the sockets of the server
+void freeServer(struct Server *server) {
+    if (server == NULL) {
+        return;
+    }
+
+    for (int fd = 0; fd < server->connection_array_size; ++fd) {
+        freeConnection(server->connections[fd]);
+    }
+    free(server->connections);
+    close(server->listen_fd);
+    close(server->epoll_fd);
+
+    free(server);
+}
+
+// stops the reader threads and frees every retired array, questions that are not answered yet are dropped
+void freeReaders(struct Readers *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->retired_count; ++i) {
+        free(pool->retired[i]);
+    }
+    free(pool->retired);
+    free(pool->retired_epochs);
+    free(pool->epochs);
+    free(pool->threads);
+    close(pool->event_fd);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->ready);
+
+    free(pool);
 }
\ No newline at end of file
@@ -1,24 +1,166 @@
-struct Person{
-    char *name;
-    char *location; //default location is "NOWHERE"
-    char **items; // item names
+// Keyword codes of tokens, names, items, locations and numbers are NOT_KEYWORD
+enum Keyword{
+    NOT_KEYWORD,
+    KEYWORD_SELL,
+    KEYWORD_BUY,
+    KEYWORD_GO,
+    KEYWORD_TO,
+    KEYWORD_FROM,
+    KEYWORD_AND,
+    KEYWORD_AT,
+    KEYWORD_HAS,
+    KEYWORD_IF,
+    KEYWORD_LESS,
+    KEYWORD_MORE,
+    KEYWORD_THAN,
+    KEYWORD_TOTAL,
+    KEYWORD_WHERE,
+    KEYWORD_WHO,
+    KEYWORD_QUESTION_MARK,
+    KEYWORD_EXIT,
+    KEYWORD_NOBODY,
+    KEYWORD_NOTHING,
+    KEYWORD_NOWHERE,
+    KEYWORD_PARAMETER // "$name", a placeholder that is only accepted in the template of a prepared statement
+};
+
+struct Token{
+    char *text; // points into the input line, the space after the token is replaced by '\0'
+    int length;
+    enum Keyword keyword;
+};
+
+// Splits a line into tokens, the tokens array is reused for every line
+struct Lexer{
+    struct Token *tokens;
+    int token_count; // the total number of tokens in the current line
+    int array_size; // size of tokens array
+    int position; // index of the next token to be read
+    bool question; // whether the line has a "?" anywhere in it
+    bool parameters; // whether "$parameter" tokens are accepted as names and amounts, only while a template is parsed
+};
+
+struct Symbol_Table{
+    char **strings; // every interned string, the index of a string is its id
+    int symbol_count; // the total number of interned strings
+    int array_size; // size of strings array
+    int *slots; // open addressing hash table that stores ids of strings (-1 marks an empty slot)
+    int slot_count; // size of slots array, always a power of two
+    int *stamps; // stamps[id] is the duplicate check that last saw the id, same size as strings array
+    int stamp; // id of the current duplicate check
+};
+
+// A block of arena memory, blocks are chained and kept for the next statement after a reset
+struct Arena_Block{
+    struct Arena_Block *next;
+    size_t size; // usable bytes in data
+    size_t used; // bytes given out since the last reset
+    char data[];
+};
+
+// Bump allocator for the memory of one statement, everything is released at once by resetArena
+struct Arena{
+    struct Arena_Block *first;
+    struct Arena_Block *current; // the block allocations are taken from
+};
+
+// Items of a person, kept in the order the person first got them
+struct Inventory{
+    int *items; // item ids
     int *amounts; // defines the amount of items (each item will have its amount on the same index)
+    int *rows; // row of the person in the column of each item
     int item_count; // the total number of items
     int item_array_size; // size of items array
+    int *item_slots; // open addressing hash table keyed by item id that stores indices of items (-1 marks an empty slot)
+    int item_slot_count; // size of item_slots array, always a power of two
+};
+
+// Item-major copy of the amounts of an item, one row for every person that has the item or may get it from a plan
+// The running totals are kept with the rows so questions about the item never look anyone up
+struct Item_Column{
+    int *handles; // person of each row
+    int *amounts; // amount of the item the person of each row has
+    int row_count; // the total number of rows
+    int row_array_size; // size of handles and amounts arrays
+    int *slots; // open addressing hash table keyed by handle that stores rows (-1 marks an empty slot)
+    int slot_count; // size of slots array, always a power of two
+    long long total; // sum of the amounts, the amount everyone has, it grows past the amount any one person can have
+    long long *place_totals; // amount the people at each place have, indexed by the place of the location
+};
+
+// People at a location, sorted by rank so that they are listed in the order they were first used
+struct Residents{
+    int *handles;
+    int count; // the total number of people at the location
+    int array_size; // size of handles array
+};
+
+// Names, items and locations are stored as the ids of their interned strings
+// People are person-major (parallel arrays indexed by handle) and their items are also item-major (a column per item)
+struct Person_Registry{
+    // Every person in the order they were created, a person's handle indexes each of these arrays
+    int *names; // name id of each person
+    int *ranks; // order in which people were first used by a statement (-1 if the person was only named by a cached plan)
+    int *locations; // default location is "NOWHERE"
+    struct Inventory *inventories;
+    int people_count; // the total number of people
+    int array_size; // size of the people arrays
+    int *slots; // open addressing hash table keyed by name id that stores handles of people (-1 marks an empty slot)
+    int slot_count; // size of slots array, always a power of two
+    struct Residents *residents; // residents of each location indexed by location id (people at NOWHERE are not indexed)
+    int residents_array_size; // size of residents array
+    int rank_count; // the number of people that have a rank
+    struct Item_Column **columns; // column of each item indexed by item id, NULL if nobody ever got the item
+    int column_array_size; // size of columns array
+    int *places; // place of each location indexed by location id, -1 if no plan goes to the location
+    int places_array_size; // size of places array
+    int place_count; // the number of places
+    int place_array_size; // size of the place_totals arrays
+};
+
+
+
+// Kinds of changes the undo log can take back
+enum Undo_Kind{
+    UNDO_AMOUNT, // amount was added to an item of a person, it is negative for a sell
+    UNDO_NEW_ITEM, // a buy added the item to the inventory of a person, it is the last item of the inventory until it is taken back
+    UNDO_MOVE // a person went to another location
 };
 
+// A change that rollback can take back
+struct Undo_Entry{
+    enum Undo_Kind kind;
+    int person;
+    int index; // index of the item in the inventory of the person
+    int amount; // amount that was added to the item
+    int location; // where the person was before the move
+};
+
+// Changes of the statement being executed in the order they were made, a savepoint is the entry_count when it was taken
+struct Undo_Log{
+    struct Undo_Entry *entries; // in the arena, there is room for every change the plan can make (undo_size of the plan)
+    int entry_count;
+};
 
+// Modes of actions, they are decided while parsing so executing an action does not compare strings
+enum Action_Mode{
+    ACTION_GO_TO,
+    ACTION_BUY,
+    ACTION_BUY_FROM,
+    ACTION_SELL,
+    ACTION_SELL_TO
+};
 
 struct Action{
-    char **subjects;
-    char *mode;
-    char **objects; // what subjects will buy or sell, where subjects will go to
+    int *subjects;
+    enum Action_Mode mode;
+    int *objects; // what subjects will buy or sell, where subjects will go to
     int *amounts; // if the mode is sell or buy how many of each object will be processed (each object will have its amount on the same index)
     int num_of_subjects; // the total number of subjects
     int num_of_objects; // the total number of objects
     int subj_array_size; // subjects array size
     int obj_array_size; // objects array size
-    char *trader; // will be used only for "sell to" and "buy from" operations
+    int trader; // will be used only for "sell to" and "buy from" operations (-1 otherwise)
 };
 
 struct Action_Sequence{
@@ -27,10 +169,18 @@ struct Action_Sequence{
     int action_count; // total number of actions
 };
 
+// Modes of conditions
+enum Condition_Mode{
+    CONDITION_AT,
+    CONDITION_HAS,
+    CONDITION_HAS_MORE,
+    CONDITION_HAS_LESS
+};
+
 struct Condition{
-    char **subjects;
-    char *mode;
-    char **objects;
+    int *subjects;
+    enum Condition_Mode mode;
+    int *objects;
     int *amounts;
     int num_of_subjects;
     int num_of_objects;
@@ -43,4 +193,264 @@ struct Condition_Sequence{
     struct Condition **conditions;
     int condition_array_size;
     int condition_count;
-};
\ No newline at end of file
+};
+
+// A parsed action sentence, the i'th action sequence is processed if the i'th condition sequence is true
+// The last action sequence does not have a condition sequence if the sentence does not end with conditions
+struct Sentence{
+    struct Action_Sequence **action_sequences;
+    int action_sequence_count; // total number of action sequences
+    int action_array_size; // action_sequences array size
+    struct Condition_Sequence **condition_sequences;
+    int condition_sequence_count; // total number of condition sequences
+    int condition_array_size; // condition_sequences array size
+};
+
+// Reads lines of any length from a file descriptor into one growing buffer
+struct Input_Reader{
+    char *buffer;
+    size_t start; // beginning of the first line that is not returned yet
+    size_t end; // end of the bytes read so far
+    size_t capacity; // buffer size
+    int fd;
+    bool eof; // true after the last read returned nothing
+};
+
+// When the output buffer is written to stdout
+enum Flush_Mode{
+    FLUSH_PER_LINE, // after every response, used in interactive mode
+    FLUSH_PER_BLOCK, // only when the buffer is full, used in batch mode
+    FLUSH_CAPTURE // never, the buffer grows instead, used for the responses of questions answered by worker threads
+};
+
+// Buffer that responses are collected in so that a response is written with one system call
+struct Output{
+    char *buffer;
+    size_t length; // bytes waiting to be written
+    size_t capacity; // buffer size
+    enum Flush_Mode mode;
+    int fd; // file descriptor the buffer is written to
+};
+
+// Phases of a statement that are measured in benchmark builds
+enum Phase{
+    PHASE_LOOKUP, // normalizing the statement text and looking up its plan
+    PHASE_LEXING,
+    PHASE_PARSING, // parsing, duplicate checking and compiling of action sentences
+    PHASE_CONDITIONS, // each condition sequence check
+    PHASE_ACTIONS, // each processAction call
+    PHASE_QUESTIONS, // parsing and answering a question
+    PHASE_COUNT
+};
+
+// Latencies of one phase in nanoseconds
+struct Phase_Samples{
+    long long *samples;
+    int count;
+    int array_size;
+};
+
+// Compiled form of a valid sentence, every array points into the memory block of the plan
+// Names are resolved to person handles, items and locations are symbol ids
+struct Plan_Action{
+    enum Action_Mode mode;
+    int *subjects; // person handles
+    int *objects;
+    int *amounts;
+    int num_of_subjects;
+    int num_of_objects;
+    int trader; // person handle for "sell to" and "buy from" (-1 otherwise)
+};
+
+struct Plan_Condition{
+    enum Condition_Mode mode;
+    int *subjects; // person handles
+    int *objects;
+    int *amounts;
+    int num_of_subjects;
+    int num_of_objects;
+};
+
+// An action sequence and the condition sequence it depends on
+struct Plan_Sequence{
+    struct Plan_Action *actions;
+    int action_count;
+    struct Plan_Condition *conditions;
+    int condition_count; // 0 if the actions are processed unconditionally (only the last sequence)
+};
+
+// Immutable execution plan of an action sentence, it is shared by every statement with the same normalized text
+struct Plan{
+    char *text; // tokens of the statement separated by single spaces
+    unsigned int hash; // hashString of text
+    bool invalid; // the statement is INVALID, there are no sequences
+    struct Plan_Sequence *sequences;
+    int sequence_count;
+    int undo_size; // the most changes the plan can make, see executePlan
+    // links of the plan cache
+    struct Plan *next_in_bucket;
+    struct Plan *newer; // towards the most recently used plan
+    struct Plan *older; // towards the least recently used plan
+};
+
+// Least recently used cache of plans keyed by normalized statement text
+struct Plan_Cache{
+    struct Plan **buckets; // hash table with chaining
+    int bucket_count; // size of buckets array, always a power of two
+    int plan_count; // the number of cached plans
+    int capacity; // the most plans that are cached, the least recently used plan is evicted after that
+    struct Plan *newest;
+    struct Plan *oldest;
+};
+// What a parameter of a prepared statement is replaced with in its plan
+enum Site_Kind{
+    SITE_PERSON, // a subject or a trader, the value is resolved to a person handle
+    SITE_SYMBOL, // an item or a location, the value is interned
+    SITE_AMOUNT
+};
+
+// A place in the plan of a prepared statement that is filled with the value of a parameter on every execution
+struct Parameter_Site{
+    int *target; // points into the memory block of the plan
+    int parameter; // index of the parameter
+    enum Site_Kind kind;
+};
+
+// A sentence template registered with "prepare", it is parsed, checked and compiled once and "execute" binds values into its plan
+struct Prepared{
+    int name;
+    struct Plan *plan; // the parameters hold the values of the last execution
+    int *parameters; // symbol ids of the "$parameter" tokens in the order they first appear in the template
+    bool *amount_parameters; // whether each parameter is an amount, otherwise it is a name, an item or a location
+    int parameter_count;
+    int parameter_array_size; // parameters and amount_parameters arrays size
+    struct Parameter_Site *sites;
+    int site_count;
+    int site_array_size; // sites array size
+};
+
+// Prepared statements by name
+struct Prepared_Table{
+    struct Prepared **statements;
+    int statement_count;
+    int array_size; // statements array size
+    int *slots; // open addressing hash table that stores indices of statements (-1 marks an empty slot)
+    int slot_count; // size of slots array, always a power of two
+};
+
+// Header of a snapshot file, the file is written in the byte order of the machine and these sections follow the header:
+// string offsets (symbol_count + 1 ints), strings (string_bytes chars, each terminated by '\0' and padded to a multiple of 4),
+// people (name, rank, location and item_count ints of each person in handle order), items (item_total ints), amounts (item_total ints)
+struct Snapshot_Header{
+    char magic[8]; // SNAPSHOT_MAGIC
+    int symbol_count;
+    int people_count;
+    int rank_count;
+    int item_total; // sum of item counts of every person
+    long long string_bytes;
+    long long journal_epoch; // epoch of the journal that continues this snapshot, 0 if it was not taken by a journal checkpoint
+};
+
+// Append-only log of the statements that changed the world since the last checkpoint, see openJournal
+struct Journal{
+    char *buffer; // statements that are not written yet, one per line
+    size_t length; // bytes in buffer
+    size_t capacity; // buffer size
+    int fd;
+    char *path;
+    char *snapshot_path; // path + ".snapshot", the snapshot of the last checkpoint
+    long long epoch; // number of the last checkpoint, written in the first line of the journal and in its snapshot
+    int pending; // statements in the buffer
+    int group_commit; // the buffer is written and synced once this many statements are pending
+    long long since_checkpoint; // statements journaled since the last checkpoint
+    long long checkpoint_interval; // a checkpoint is taken after this many statements, 0 if never
+};
+
+// A statement in the window of a parallel batch, see scheduleStatement
+struct Task{
+    struct Plan *plan; // plan of an action sentence, NULL for a question or an empty line
+    bool owns_plan; // the plan was compiled in this window, it is cached after the window is executed
+    bool is_question;
+    struct Lexer question; // tokens of a question, they point into the mapped script
+    struct Output *response; // captured response of a question, reused by the next windows
+    int level; // tasks of the same level do not touch the same people so they run at the same time
+};
+
+// Executes windows of statements with worker threads, see runWindow
+struct Parallel{
+    struct Person_Registry *registry;
+    int thread_count; // workers and the main thread
+    pthread_t *workers;
+    pthread_barrier_t barrier; // every thread waits here before a window and after each level of it
+    bool stopping; // set before the workers are released for the last time so that they return
+    struct Task *tasks;
+    int task_count;
+    int window_size; // size of tasks array, the window is executed when it is full
+    int *order; // indices of tasks sorted by level
+    int *level_starts; // tasks of level l are order[level_starts[l]..level_starts[l + 1])
+    int *level_next; // index in order of the next task of each level that is not taken yet
+    int level_count;
+    int window; // id of the current window, levels of people with an older stamp are stale
+    int *read_levels; // highest level of the window that reads a person, indexed by handle
+    int *write_levels; // highest level of the window that writes a person
+    int *stamps; // window that read_levels and write_levels of a person belong to
+    int levels_size; // size of read_levels, write_levels and stamps arrays
+    int location_read_level; // highest level that reads the residents of locations (who at)
+    int location_write_level; // highest level that moves someone to another location (go to)
+    int everyone_read_level; // highest level that reads every person (total of an item)
+    int everyone_write_level; // highest level that writes any person
+};
+
+// A client of the server, statements are read from its socket and the responses are sent back in the same order
+struct Connection{
+    int fd;
+    struct Input_Reader *reader; // statements that are received but not processed yet
+    struct Output *output; // responses that are not sent yet, it grows instead of being flushed
+    size_t sent; // bytes at the beginning of output that are already sent
+    size_t durable; // bytes at the beginning of output that may be sent, the rest waits for the journal, see holdResponses
+    bool closing; // the client sent "exit" or closed its side, the connection is closed after its last response
+    struct Question_Job *question; // job its questions are given to readers with, NULL until the first one
+    bool waiting; // a reader answers its question, the next statements wait for the answer
+    bool failed; // the socket failed, the connection is closed once it does not wait for a reader
+    unsigned int events; // epoll events the connection waits for
+};
+
+// Serves every client over the same world with one epoll set, see runServer
+struct Server{
+    int listen_fd;
+    int epoll_fd;
+    struct Connection **connections; // indexed by file descriptor, NULL if it is not a client
+    int connection_array_size; // connections array size
+    int connection_count;
+    bool holding; // a connection holds responses until the journal is committed, see releaseResponses
+};
+
+// A question of a connection that is answered by a reader thread, see dispatchQuestion
+struct Question_Job{
+    struct Connection *connection;
+    char *text; // copy of the question, the tokens point into it
+    size_t text_size; // text buffer size
+    struct Lexer *lexer;
+    struct Output *response; // the answer, it is appended to the output of the connection by completeQuestions
+    struct Question_Job *next; // next job in the queue of the readers
+};
+
+// Threads that answer questions without locking the world while the server thread changes it, see answerConcurrently
+struct Readers{
+    struct Person_Registry *registry;
+    pthread_t *threads;
+    int thread_count;
+    int started; // readers that took their index in epochs
+    long long *epochs; // epoch each reader started its current answer in, 0 while it is not reading the world
+    pthread_mutex_t lock; // protects the queues, the world is never locked
+    pthread_cond_t ready; // signaled when a question is queued
+    struct Question_Job *waiting_first; // questions that are not answered yet, in the order they were queued
+    struct Question_Job *waiting_last;
+    struct Question_Job *answered; // answered questions, the server takes them when event_fd is readable
+    int event_fd;
+    bool stopping;
+    void **retired; // arrays the writer replaced, they are freed once no reader can still be reading them
+    long long *retired_epochs; // epoch each array was retired in
+    int retired_count;
+    int retired_array_size; // retired and retired_epochs array size
+};
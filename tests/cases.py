@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+# Runs every name.in script of a directory in batch mode and checks that the responses are the ones in name.out
+# usage: tests/cases.py ringmaster directory [options of ringmaster], make test runs it on tests/parser and tests/statements
+#   tests/parser has a case for each statement the recursive descent parser answers differently from the goto parser:
+#   sell to and buy from followed by "and", stray words after an "at" or "has" condition, "if" after a condition,
+#   a trailing "and" after a condition and conditions whose subjects turn out to be the subjects of an action
+#   tests/statements has scripts of the other statements, tests/roundtrip.py runs them too
+import os, subprocess, sys
+
+def run(binary, script, options):
+    result = subprocess.run([binary, '--batch', script] + options, stdout=subprocess.PIPE, timeout=60)
+    return result.returncode, result.stdout.decode()
+
+def main():
+    binary, directory, options = sys.argv[1], sys.argv[2], sys.argv[3:]
+    failures = 0
+    for name in sorted(os.listdir(directory)):
+        if not name.endswith('.in'):
+            continue
+        script = os.path.join(directory, name)
+        with open(script[:-3] + '.out') as file:
+            expected = file.read().split('\n')
+        code, output = run(binary, script, options)
+        output = output.split('\n')
+        # the first different response tells which statement is answered differently
+        line = next((i for i, (got, want) in enumerate(zip(output, expected)) if got != want), min(len(output), len(expected)))
+        passed = code == 0 and output == expected
+        if passed:
+            print('ok: %s' % name[:-3])
+        else:
+            print('FAILED: %s, exit code %d, response %d is %r instead of %r' % (name[:-3], code, line + 1,
+                  output[line] if line < len(output) else None, expected[line] if line < len(expected) else None))
+        failures += not passed
+    sys.exit(1 if failures else 0)
+
+main()
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Pipelines statements whose responses are far larger than the output limit of a connection and checks that every
+# response arrives, with the client keeping its side open and with the client closing it after the last statement
+# usage: tests/pipeline.py [ringmaster [options of the server]], make test runs it with ./ringmaster
+import os, socket, subprocess, sys, tempfile, threading, time
+
+PEOPLE = 20000
+QUESTIONS = 40 # every answer names all the people, about 160KB each
+
+def name(number):
+    letters = 'p'
+    while True:
+        letters += chr(ord('a') + number % 26)
+        number //= 26
+        if number == 0:
+            return letters
+
+def pipeline(address, close_side):
+    statements = ''.join(name(i) + ' go to x\n' for i in range(PEOPLE)) + 'who at x ?\n' * QUESTIONS
+    expected = 'OK\n' * PEOPLE + (' and '.join(name(i) for i in range(PEOPLE)) + '\n') * QUESTIONS
+    client = socket.socket(socket.AF_UNIX)
+    client.connect(address)
+    client.settimeout(10)
+    sender = threading.Thread(target=client.sendall, args=(statements.encode(),))
+    sender.start()
+    received = bytearray()
+    try:
+        while len(received) < len(expected):
+            if close_side and not sender.is_alive():
+                client.shutdown(socket.SHUT_WR)
+                close_side = False
+            chunk = client.recv(1 << 16)
+            if not chunk:
+                break
+            received += chunk
+    except socket.timeout:
+        pass
+    sender.join()
+    client.close()
+    return received.decode() == expected, received.count(b'\n'), expected.count('\n')
+
+def main():
+    binary = sys.argv[1] if len(sys.argv) > 1 else './ringmaster'
+    directory = tempfile.mkdtemp()
+    address = os.path.join(directory, 'socket')
+    server = subprocess.Popen([binary, '--listen', address] + sys.argv[2:])
+    try:
+        for _ in range(100):
+            if os.path.exists(address):
+                break
+            time.sleep(0.05)
+        failures = 0
+        for close_side in (False, True):
+            # the second connection moves the same people to x again, the responses are the same
+            passed, lines, expected = pipeline(address, close_side)
+            print('%s: %s side, %d of %d lines' % ('ok' if passed else 'FAILED', 'closed' if close_side else 'open', lines, expected))
+            failures += not passed
+    finally:
+        server.terminate()
+        server.wait()
+        if os.path.exists(address):
+            os.unlink(address)
+        os.rmdir(directory)
+    sys.exit(1 if failures else 0)
+
+main()
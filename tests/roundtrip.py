@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Runs every script split in two halves that share their world through a snapshot, a journal or a killed server, and
+# checks that the responses are the ones of a plain run of the whole script, the same way for --threads and --atomic
+# usage: tests/roundtrip.py ringmaster script..., make test runs it on generated workloads and tests/statements
+import os, shutil, signal, socket, subprocess, sys, tempfile, time
+
+THREADS = '--threads=4'
+
+def run(binary, lines, options, directory):
+    script = os.path.join(directory, 'script.txt')
+    with open(script, 'w') as file:
+        file.write(''.join(lines))
+    result = subprocess.run([binary, '--batch', script] + options, stdout=subprocess.PIPE, timeout=300)
+    if result.returncode != 0:
+        return None
+    return result.stdout.decode()
+
+# sends the lines to a server with a journal and kills it once every response arrived
+# Responses are held until their statements are synced, so all of them must be replayed after the kill
+def serve(binary, lines, options, directory):
+    address = os.path.join(directory, 'socket')
+    server = subprocess.Popen([binary, '--listen', address] + options)
+    try:
+        for _ in range(100):
+            if os.path.exists(address):
+                break
+            time.sleep(0.05)
+        client = socket.socket(socket.AF_UNIX)
+        client.connect(address)
+        client.settimeout(60)
+        client.sendall(''.join(lines).encode())
+        client.shutdown(socket.SHUT_WR)
+        received = bytearray()
+        while True:
+            chunk = client.recv(1 << 16)
+            if not chunk:
+                break
+            received += chunk
+        client.close()
+    finally:
+        server.send_signal(signal.SIGKILL)
+        server.wait()
+        if os.path.exists(address):
+            os.unlink(address)
+    return received.decode()
+
+def check(binary, lines, directory):
+    half = len(lines) // 2
+    first, second = lines[:half], lines[half:]
+    checkpoint = '--checkpoint=%d' % max(1, half // 3) # the restart loads a checkpoint and replays the statements after it
+    journal = os.path.join(directory, 'journal')
+    snapshot = os.path.join(directory, 'snapshot')
+    results = {}
+    for mode, atomic in (('plain', []), ('atomic', ['--atomic'])):
+        reference = run(binary, lines, atomic, directory)
+        for name, options in (('threads', [THREADS]), ('snapshot', None), ('journal', None), ('server', None)):
+            for path in (journal, journal + '.snapshot', snapshot):
+                if os.path.exists(path):
+                    os.unlink(path)
+            if name == 'threads':
+                output = run(binary, lines, atomic + options, directory)
+            elif name == 'snapshot':
+                # prepared statements are not part of the world, the second half prepares them again and skips their responses
+                prepared = [line for line in first if line.startswith('prepare ')]
+                output = run(binary, first, atomic + ['--save', snapshot], directory)
+                loaded = run(binary, prepared + second, atomic + ['--load', snapshot], directory)
+                output = output and loaded and output + ''.join(loaded.splitlines(True)[len(prepared):])
+            elif name == 'journal':
+                output = run(binary, first, atomic + ['--journal', journal, '--group-commit=8', checkpoint], directory)
+                output = output and output + (run(binary, second, atomic + ['--journal', journal], directory) or '')
+            else:
+                output = serve(binary, first, atomic + ['--journal', journal, '--group-commit=8', checkpoint], directory)
+                output = output + (run(binary, second, atomic + ['--journal', journal], directory) or '')
+            results['%s %s' % (mode, name)] = reference is not None and output == reference
+    return results
+
+def main():
+    binary = sys.argv[1]
+    failures = 0
+    for path in sys.argv[2:]:
+        with open(path) as file:
+            lines = [line if line.endswith('\n') else line + '\n' for line in file]
+        if 'exit\n' in lines: # the statements after exit are never run
+            lines = lines[:lines.index('exit\n')]
+        directory = tempfile.mkdtemp()
+        try:
+            for name, passed in check(binary, lines, directory).items():
+                print('%s: %s, %s' % ('ok' if passed else 'FAILED', os.path.basename(path), name))
+                failures += not passed
+        finally:
+            shutil.rmtree(directory)
+    sys.exit(1 if failures else 0)
+
+main()